@@ -1,25 +1,106 @@
 #include "AsyncMqttClient.hpp"
 
+#include <lwip/dns.h>
+#if defined(ESP32)
+#include <lwip/tcpip.h>
+#endif
+
+// lwIP is not thread-safe: on the ESP32 it may only be called from its own thread
+static void inLwipThread(void (*function)(void*), void* arg) {
+#if defined(ESP32)
+  struct Call {
+    struct tcpip_api_call_data call;  // first member, tcpip_api_call hands it back
+    void (*function)(void*);
+    void* arg;
+  } call;
+  call.function = function;
+  call.arg = arg;
+  tcpip_api_call([](struct tcpip_api_call_data* data) -> err_t {
+    Call* call = reinterpret_cast<Call*>(data);
+    call->function(call->arg);
+    return ERR_OK;
+  }, &call.call);
+#else
+  function(arg);
+#endif
+}
+
 AsyncMqttClient::AsyncMqttClient()
 : _client()
-, _head(nullptr)
-, _tail(nullptr)
+, _lanes()
+, _sendingLane(LANES)
+, _nextSequence(0)
 , _sent(0)
+, _awaitingConnAck(false)
+, _pendingSubAcks()
+, _maxPendingSubAcks(1)
+, _inflight()
+, _packetIds()
+, _maxInflight(MQTT_MAX_INFLIGHT)
+, _retransmitTimeout(0)
+, _retransmitMaxTimeout(0)
+, _maxRetries(0)
+, _timerWheel()
+, _timerTick(0)
+, _pendingTcpAcks()
+, _bytesSent(0)
+, _bytesAcked(0)
+, _coalesceThreshold(0)
+, _coalesceDeadline(0)
+, _unflushed(0)
+, _unflushedSince(0)
+, _stats{0}
+, _maxQueueBytes(MQTT_MAX_QUEUE_BYTES)
+, _maxQueuePackets(MQTT_MAX_QUEUE_PACKETS)
+, _queuedBytes(0)
+, _queuedPackets(0)
+, _writableWanted(false)
+, _packetIdWanted(false)
 , _state(DISCONNECTED)
 , _disconnectReason(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED)
 , _lastClientActivity(0)
 , _lastServerActivity(0)
 , _lastPingRequestTime(0)
+, _pingSentAt(0)
+, _reconnectMinDelay(0)
+, _reconnectMaxDelay(0)
+, _reconnectStablePeriod(0)
+, _reconnectDelay(0)
+, _reconnectWanted(false)
+, _connectedSince(0)
+, _offline(false)
+, _offlineSince(0)
+#if defined(ESP32)
+, _reconnectTimer(nullptr)
+#elif defined(ESP8266)
+, _reconnectTimer()
+#endif
 , _generatedClientId{0}
+, _servers()
 , _ip()
 , _host(nullptr)
 , _useIp(false)
+, _dnsIndex(-1)
+, _dnsAttempt(0)
+, _dnsLookup(nullptr)
 #if ASYNC_TCP_SSL_ENABLED
 , _secure(false)
+, _axTls()
+, _tls(&_axTls)
 #endif
 , _port(0)
+, _connectStartedAt(0)
 , _keepAlive(15)
 , _cleanSession(true)
+, _sessionExpiryInterval(UINT32_MAX)
+, _protocolLevel(AsyncMqttClientInternals::ProtocolLevel.MQTT_3_1_1)
+, _maxPacketSize(0)
+, _serverReceiveMaximum(UINT16_MAX)
+, _serverMaximumPacketSize(0)
+, _serverTopicAliasMaximum(0)
+, _topicAliases()
+, _subscriptionReplay(false)
+, _pipelineConnect(false)
 , _clientId(nullptr)
 , _username(nullptr)
 , _password(nullptr)
@@ -34,14 +115,26 @@ AsyncMqttClient::AsyncMqttClient()
 , _onConnectUserCallbacks()
 , _onDisconnectUserCallbacks()
 , _onSubscribeUserCallbacks()
+, _onSubscribeResultsUserCallbacks()
 , _onUnsubscribeUserCallbacks()
 , _onMessageUserCallbacks()
+, _topicRoutes()
+, _messageRoutes()
 , _onPublishUserCallbacks()
+, _onErrorUserCallbacks()
+, _onWritableUserCallbacks()
 , _parsingInformation { .bufferState = AsyncMqttClientInternals::BufferState::NONE }
+, _reassemblyBuffer(nullptr)
+, _reassemblySize(0)
+, _parser()
 , _currentParsedPacket(nullptr)
 , _remainingLengthBufferPosition(0)
 , _remainingLengthBuffer{0}
-, _pendingPubRels() {
+, _pendingPubRels()
+, _sessionStore(nullptr)
+, _sessionCompactSize(MQTT_SESSION_COMPACT_SIZE)
+, _journalSize(0)
+, _sessionCompactDue(false) {
   _client.onConnect([](void* obj, AsyncClient* c) { (static_cast<AsyncMqttClient*>(obj))->_onConnect(); }, this);
   _client.onDisconnect([](void* obj, AsyncClient* c) { (static_cast<AsyncMqttClient*>(obj))->_onDisconnect(); }, this);
   // _client.onError([](void* obj, AsyncClient* c, int8_t error) { (static_cast<AsyncMqttClient*>(obj))->_onError(error); }, this);
@@ -53,22 +146,32 @@ AsyncMqttClient::AsyncMqttClient()
 #ifdef ESP32
   sprintf(_generatedClientId, "esp32-%06llx", ESP.getEfuseMac());
   _xSemaphore = xSemaphoreCreateMutex();
+  _reconnectTimer = xTimerCreate("mqttReconnect", 1, pdFALSE, this, [](TimerHandle_t timer) {
+    _onReconnectTimer(static_cast<AsyncMqttClient*>(pvTimerGetTimerID(timer)));
+  });
+  _flushTimer = xTimerCreate("mqttFlush", 1, pdFALSE, this, [](TimerHandle_t timer) {
+    _onFlushTimer(static_cast<AsyncMqttClient*>(pvTimerGetTimerID(timer)));
+  });
 #elif defined(ESP8266)
   sprintf(_generatedClientId, "esp8266-%06x", ESP.getChipId());
 #endif
   _clientId = _generatedClientId;
 
+  _parsingInformation.protocolLevel = _protocolLevel;
   setMaxTopicLength(128);
 }
 
 AsyncMqttClient::~AsyncMqttClient() {
-  delete _currentParsedPacket;
+  _cancelResolve();
+  _freeCurrentParsedPacket();
   delete[] _parsingInformation.topicBuffer;
+  delete[] _reassemblyBuffer;
   _clear();
   _pendingPubRels.clear();
-  _pendingPubRels.shrink_to_fit();
   _clearQueue(false);  // _clear() doesn't clear session data
 #ifdef ESP32
+  xTimerDelete(_reconnectTimer, portMAX_DELAY);
+  xTimerDelete(_flushTimer, portMAX_DELAY);
   vSemaphoreDelete(_xSemaphore);
 #endif
 }
@@ -88,6 +191,27 @@ AsyncMqttClient& AsyncMqttClient::setCleanSession(bool cleanSession) {
   return *this;
 }
 
+AsyncMqttClient& AsyncMqttClient::setSessionExpiryInterval(uint32_t seconds) {
+  _sessionExpiryInterval = seconds;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setProtocolVersion(uint8_t version) {
+  if (version != AsyncMqttClientInternals::ProtocolLevel.MQTT_3_1_1 && version != AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0) return *this;
+  _protocolLevel = version;
+  _parsingInformation.protocolLevel = version;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setAutoReconnect(uint32_t minDelay, uint32_t maxDelay, uint32_t stablePeriod) {
+  _reconnectMinDelay = minDelay;
+  _reconnectMaxDelay = (maxDelay > minDelay) ? maxDelay : minDelay;
+  _reconnectStablePeriod = stablePeriod;
+  _reconnectDelay = minDelay;
+  if (minDelay == 0) _cancelReconnect();
+  return *this;
+}
+
 AsyncMqttClient& AsyncMqttClient::setMaxTopicLength(uint16_t maxTopicLength) {
   _parsingInformation.maxTopicLength = maxTopicLength;
   delete[] _parsingInformation.topicBuffer;
@@ -95,6 +219,71 @@ AsyncMqttClient& AsyncMqttClient::setMaxTopicLength(uint16_t maxTopicLength) {
   return *this;
 }
 
+AsyncMqttClient& AsyncMqttClient::setMaxPacketSize(uint32_t maxSize) {
+  _maxPacketSize = maxSize;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setSubscriptionReplay(bool replay) {
+  _subscriptionReplay = replay;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setPipelinedConnect(bool pipelined) {
+  _pipelineConnect = pipelined;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setMessageReassembly(size_t maxSize) {
+  delete[] _reassemblyBuffer;
+  _reassemblyBuffer = (maxSize > 0) ? new char[maxSize] : nullptr;
+  _reassemblySize = maxSize;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setMaxInflight(uint16_t maxInflight) {
+  _maxInflight = (maxInflight > 0) ? maxInflight : 1;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setMaxPendingSubscriptions(uint8_t maxPending) {
+  _maxPendingSubAcks = (maxPending > 0) ? maxPending : 1;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setWriteCoalescing(size_t threshold, uint32_t flushDeadline) {
+  _coalesceThreshold = threshold;
+  _coalesceDeadline = flushDeadline;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setQueueLimits(size_t maxBytes, uint16_t maxPackets) {
+  _maxQueueBytes = maxBytes;
+  _maxQueuePackets = maxPackets;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setRetransmission(uint32_t timeout, uint8_t maxRetries, uint32_t maxTimeout) {
+  _retransmitTimeout = timeout;
+  _maxRetries = maxRetries;
+  _retransmitMaxTimeout = (maxTimeout > timeout) ? maxTimeout : timeout;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setSessionStore(AsyncMqttClientSessionStore* store, size_t compactSize) {
+  _sessionStore = store;
+  _sessionCompactSize = compactSize;
+  if (!_sessionStore) return *this;
+  if (_state == DISCONNECTED) {
+    _restoreSession();
+  } else {
+    SEMAPHORE_TAKE();
+    _compactSession(true);  // start the journal with the current session
+    SEMAPHORE_GIVE();
+  }
+  return *this;
+}
+
 AsyncMqttClient& AsyncMqttClient::setCredentials(const char* username, const char* password) {
   _username = username;
   _password = password;
@@ -111,16 +300,34 @@ AsyncMqttClient& AsyncMqttClient::setWill(const char* topic, uint8_t qos, bool r
 }
 
 AsyncMqttClient& AsyncMqttClient::setServer(IPAddress ip, uint16_t port) {
-  _useIp = true;
-  _ip = ip;
-  _port = port;
+  SEMAPHORE_TAKE();
+  _servers.set(ip, nullptr, port);
+  SEMAPHORE_GIVE();
+  _pickServer();
   return *this;
 }
 
 AsyncMqttClient& AsyncMqttClient::setServer(const char* host, uint16_t port) {
-  _useIp = false;
-  _host = host;
-  _port = port;
+  SEMAPHORE_TAKE();
+  _servers.set(IPAddress(), host, port);  // keeps the cached addresses and measures if the server is the same
+  SEMAPHORE_GIVE();
+  _pickServer();
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::addServer(IPAddress ip, uint16_t port) {
+  SEMAPHORE_TAKE();
+  _servers.add(ip, nullptr, port);
+  SEMAPHORE_GIVE();
+  if (_servers.size() == 1) _pickServer();
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::addServer(const char* host, uint16_t port) {
+  SEMAPHORE_TAKE();
+  _servers.add(IPAddress(), host, port);
+  SEMAPHORE_GIVE();
+  if (_servers.size() == 1) _pickServer();
   return *this;
 }
 
@@ -136,6 +343,18 @@ AsyncMqttClient& AsyncMqttClient::addServerFingerprint(const uint8_t* fingerprin
   _secureServerFingerprints.push_back(newFingerprint);
   return *this;
 }
+
+AsyncMqttClient& AsyncMqttClient::setTlsSession(size_t index, const AsyncMqttClientTlsSession& session) {
+  SEMAPHORE_TAKE();
+  if (index < _servers.size() && session.length <= MQTT_TLS_SESSION_ID_SIZE) _servers[index].tlsSession = session;
+  SEMAPHORE_GIVE();
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setTls(AsyncMqttClientTls* tls) {
+  _tls = tls ? tls : &_axTls;
+  return *this;
+}
 #endif
 
 AsyncMqttClient& AsyncMqttClient::onConnect(AsyncMqttClientInternals::OnConnectUserCallback callback) {
@@ -153,6 +372,11 @@ AsyncMqttClient& AsyncMqttClient::onSubscribe(AsyncMqttClientInternals::OnSubscr
   return *this;
 }
 
+AsyncMqttClient& AsyncMqttClient::onSubscribeResults(AsyncMqttClientInternals::OnSubscribeResultsUserCallback callback) {
+  _onSubscribeResultsUserCallbacks.push_back(callback);
+  return *this;
+}
+
 AsyncMqttClient& AsyncMqttClient::onUnsubscribe(AsyncMqttClientInternals::OnUnsubscribeUserCallback callback) {
   _onUnsubscribeUserCallbacks.push_back(callback);
   return *this;
@@ -163,20 +387,40 @@ AsyncMqttClient& AsyncMqttClient::onMessage(AsyncMqttClientInternals::OnMessageU
   return *this;
 }
 
+AsyncMqttClient& AsyncMqttClient::onMessage(const char* filter, AsyncMqttClientInternals::OnMessageUserCallback callback) {
+  _topicRoutes.insert(filter).handlers.push_back(callback);
+  return *this;
+}
+
 AsyncMqttClient& AsyncMqttClient::onPublish(AsyncMqttClientInternals::OnPublishUserCallback callback) {
   _onPublishUserCallbacks.push_back(callback);
   return *this;
 }
 
+AsyncMqttClient& AsyncMqttClient::onError(AsyncMqttClientInternals::OnErrorUserCallback callback) {
+  _onErrorUserCallbacks.push_back(callback);
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::onWritable(AsyncMqttClientInternals::OnWritableUserCallback callback) {
+  _onWritableUserCallbacks.push_back(callback);
+  return *this;
+}
+
 void AsyncMqttClient::_freeCurrentParsedPacket() {
-  delete _currentParsedPacket;
+  if (_currentParsedPacket) _currentParsedPacket->~Packet();
   _currentParsedPacket = nullptr;
 }
 
 void AsyncMqttClient::_clear() {
   _lastPingRequestTime = 0;
+  _pingSentAt = 0;
   _freeCurrentParsedPacket();
   _clearQueue(true);  // keep session data for now
+  _releaseTcpAcked(true);  // the TCP send buffer is gone with the connection
+  _bytesSent = 0;
+  _bytesAcked = 0;
+  _unflushed = 0;
 
   _parsingInformation.bufferState = AsyncMqttClientInternals::BufferState::NONE;
 
@@ -187,24 +431,98 @@ void AsyncMqttClient::_clear() {
 void AsyncMqttClient::_onConnect() {
   log_i("TCP conn, MQTT CONNECT");
 #if ASYNC_TCP_SSL_ENABLED
-  if (_secure && _secureServerFingerprints.size() > 0) {
-    SSL* clientSsl = _client.getSSL();
-
-    bool sslFoundFingerprint = false;
-    for (std::array<uint8_t, SHA1_SIZE> fingerprint : _secureServerFingerprints) {
-      if (ssl_match_fingerprint(clientSsl, fingerprint.data()) == SSL_OK) {
+  if (_secure) {
+    SEMAPHORE_TAKE();
+    AsyncMqttClientTlsSession session = _servers.current().tlsSession;
+    SEMAPHORE_GIVE();
+    // The server echoes the offered session ID when it resumes the session. No
+    // certificate is sent then: the fingerprint it matched when the session
+    // was made has to be accepted still.
+    uint8_t sessionId[MQTT_TLS_SESSION_ID_SIZE];
+    uint8_t sessionIdLength = _tls->sessionId(&_client, sessionId);
+    bool resumed = session.length > 0 && sessionIdLength == session.length && memcmp(sessionId, session.id, session.length) == 0;
+
+    bool sslFoundFingerprint = _secureServerFingerprints.size() == 0;
+    const uint8_t* matchedFingerprint = nullptr;
+    for (const std::array<uint8_t, SHA1_SIZE>& fingerprint : _secureServerFingerprints) {
+      if (resumed ? memcmp(session.fingerprint, fingerprint.data(), SHA1_SIZE) == 0 : _tls->matchFingerprint(&_client, fingerprint.data())) {
         sslFoundFingerprint = true;
+        matchedFingerprint = fingerprint.data();
         break;
       }
     }
 
     if (!sslFoundFingerprint) {
+      SEMAPHORE_TAKE();
+      _servers.current().tlsSession.length = 0;  // the next handshake is a full one
+      SEMAPHORE_GIVE();
       _disconnectReason = AsyncMqttClientDisconnectReason::TLS_BAD_FINGERPRINT;
       _client.close(true);
       return;
     }
+    if (resumed) {
+      _stats.tlsResumptions++;
+    } else {
+      session.length = sessionIdLength;
+      memcpy(session.id, sessionId, sessionIdLength);
+      if (matchedFingerprint) {
+        memcpy(session.fingerprint, matchedFingerprint, SHA1_SIZE);
+      } else {
+        memset(session.fingerprint, 0, SHA1_SIZE);
+      }
+      SEMAPHORE_TAKE();
+      _servers.current().tlsSession = session;
+      SEMAPHORE_GIVE();
+    }
   }
 #endif
+  uint32_t now = millis();
+  SEMAPHORE_TAKE();
+  AsyncMqttClientInternals::ServerEndpoint& server = _servers.current();
+  // a lookup by the TCP library is in the measure, as the next connection skips it anyway
+  server.measure(&server.connectTime, now - _connectStartedAt);
+  _connectStartedAt = now;  // for the CONNACK latency
+  SEMAPHORE_GIVE();
+  if (!_useIp) {
+    IPAddress remoteIp = _client.remoteIP();
+    SEMAPHORE_TAKE();
+    if (_dnsIndex >= 0) {
+      _servers.current().dns.promote(remoteIp);
+    } else if (static_cast<uint32_t>(remoteIp) != 0) {
+      _servers.current().dns.add(remoteIp, now);  // just looked up by the TCP library
+    }
+    SEMAPHORE_GIVE();
+    _dnsIndex = -1;
+    _dnsAttempt = 0;
+  }
+  SEMAPHORE_TAKE();
+  _serverReceiveMaximum = UINT16_MAX;  // the defaults if the CONNACK has no such property
+  _serverMaximumPacketSize = 0;
+  _serverTopicAliasMaximum = 0;
+  _topicAliases.reset(0);  // until the CONNACK tells how many the server takes
+  SEMAPHORE_GIVE();
+  uint8_t properties[13];
+  uint8_t propertiesLength = 0;
+  if (!_cleanSession) {
+    // without it an MQTT 5.0 server ends the session with the connection
+    properties[propertiesLength++] = AsyncMqttClientInternals::Property.SESSION_EXPIRY_INTERVAL;
+    properties[propertiesLength++] = _sessionExpiryInterval >> 24;
+    properties[propertiesLength++] = (_sessionExpiryInterval >> 16) & 0xFF;
+    properties[propertiesLength++] = (_sessionExpiryInterval >> 8) & 0xFF;
+    properties[propertiesLength++] = _sessionExpiryInterval & 0xFF;
+  }
+  // MQTT 5.0 flow control: incoming QoS 2 messages are tracked until their PUBREL, QoS 1 ones are acked right away
+  static const uint16_t receiveMaximum = MQTT_PENDING_PUBREL_SLOTS - 1;
+  properties[propertiesLength++] = AsyncMqttClientInternals::Property.RECEIVE_MAXIMUM;
+  properties[propertiesLength++] = receiveMaximum >> 8;
+  properties[propertiesLength++] = receiveMaximum & 0xFF;
+  if (_maxPacketSize > 0) {
+    properties[propertiesLength++] = AsyncMqttClientInternals::Property.MAXIMUM_PACKET_SIZE;
+    properties[propertiesLength++] = _maxPacketSize >> 24;
+    properties[propertiesLength++] = (_maxPacketSize >> 16) & 0xFF;
+    properties[propertiesLength++] = (_maxPacketSize >> 8) & 0xFF;
+    properties[propertiesLength++] = _maxPacketSize & 0xFF;
+  }
   AsyncMqttClientInternals::OutPacket* msg =
   new AsyncMqttClientInternals::ConnectOutPacket(_cleanSession,
                                                  _username,
@@ -215,18 +533,40 @@ void AsyncMqttClient::_onConnect() {
                                                  _willPayload,
                                                  _willPayloadLength,
                                                  _keepAlive,
-                                                 _clientId);
+                                                 _clientId,
+                                                 _protocolLevel,
+                                                 properties,
+                                                 propertiesLength);
   _addFront(msg);
   _handleQueue();
 }
 
 void AsyncMqttClient::_onDisconnect() {
   log_i("TCP disconn");
+  bool wasConnected = _state == CONNECTED;
+  if (_state == CONNECTING && _servers.size() > 0) {
+    SEMAPHORE_TAKE();
+    AsyncMqttClientInternals::ServerEndpoint& server = _servers.current();
+    if (server.failures < UINT8_MAX) server.failures++;  // no connection, or no accepting CONNACK
+    SEMAPHORE_GIVE();
+  }
+  _connectStartedAt = 0;
   _state = DISCONNECTED;
 
   _clear();
+  if (_dnsIndex >= 0) {
+    // the cached address did not answer, the next attempt tries the next one
+    _dnsIndex = -1;
+    _dnsAttempt++;
+  }
+  if (_reconnectWanted && !_offline) {
+    _offline = true;
+    _offlineSince = millis();
+  }
 
-  for (auto callback : _onDisconnectUserCallbacks) callback(_disconnectReason);
+  for (const auto& callback : _onDisconnectUserCallbacks) callback(_disconnectReason);
+  // the handlers may have called connect() or disconnect() already
+  if (_reconnectWanted && _reconnectMinDelay > 0 && _state == DISCONNECTED) _scheduleReconnect(wasConnected);
 }
 
 /*
@@ -242,6 +582,8 @@ void AsyncMqttClient::_onTimeout() {
 
 void AsyncMqttClient::_onAck(size_t len) {
   log_i("ack %u", len);
+  _bytesAcked += len;
+  _releaseTcpAcked(false);
   _handleQueue();
 }
 
@@ -253,66 +595,91 @@ void AsyncMqttClient::_onData(char* data, size_t len) {
   do {
     switch (_parsingInformation.bufferState) {
       case AsyncMqttClientInternals::BufferState::NONE:
+        // Packets complete within the segment are handled in place. Only a packet
+        // straddling segments goes through the parsers below, byte by byte.
+        while (currentBytePosition < len && _parsingInformation.bufferState == AsyncMqttClientInternals::BufferState::NONE) {
+          size_t packetLength = _parseInPlace(data + currentBytePosition, len - currentBytePosition);
+          if (packetLength == 0) break;
+          currentBytePosition += packetLength;
+        }
+        if (currentBytePosition == len || _parsingInformation.bufferState != AsyncMqttClientInternals::BufferState::NONE) break;
+        _freeCurrentParsedPacket();  // left over if the last message was ignored
         currentByte = data[currentBytePosition++];
-        _parsingInformation.packetType = currentByte >> 4;
-        _parsingInformation.packetFlags = (currentByte << 4) >> 4;
+        _parsingInformation.packetType = static_cast<uint8_t>(currentByte) >> 4;  // char may be signed
+        _parsingInformation.packetFlags = currentByte & 0x0F;
         _parsingInformation.bufferState = AsyncMqttClientInternals::BufferState::REMAINING_LENGTH;
         switch (_parsingInformation.packetType) {
           case AsyncMqttClientInternals::PacketType.CONNACK:
             log_i("rcv CONNACK");
-            _currentParsedPacket = new AsyncMqttClientInternals::ConnAckPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onConnAck, this, std::placeholders::_1, std::placeholders::_2));
+            _currentParsedPacket = new (&_parser.connAck) AsyncMqttClientInternals::ConnAckPacket(&_parsingInformation, this);
             _client.setRxTimeout(0);
             break;
           case AsyncMqttClientInternals::PacketType.PINGRESP:
             log_i("rcv PINGRESP");
-            _currentParsedPacket = new AsyncMqttClientInternals::PingRespPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onPingResp, this));
+            _currentParsedPacket = new (&_parser.pingResp) AsyncMqttClientInternals::PingRespPacket(&_parsingInformation, this);
             break;
           case AsyncMqttClientInternals::PacketType.SUBACK:
             log_i("rcv SUBACK");
-            _currentParsedPacket = new AsyncMqttClientInternals::SubAckPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onSubAck, this, std::placeholders::_1, std::placeholders::_2));
+            _currentParsedPacket = new (&_parser.subAck) AsyncMqttClientInternals::SubAckPacket(&_parsingInformation, this);
             break;
           case AsyncMqttClientInternals::PacketType.UNSUBACK:
             log_i("rcv UNSUBACK");
-            _currentParsedPacket = new AsyncMqttClientInternals::UnsubAckPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onUnsubAck, this, std::placeholders::_1));
+            _currentParsedPacket = new (&_parser.unsubAck) AsyncMqttClientInternals::UnsubAckPacket(&_parsingInformation, this);
             break;
           case AsyncMqttClientInternals::PacketType.PUBLISH:
             log_i("rcv PUBLISH");
-            _currentParsedPacket = new AsyncMqttClientInternals::PublishPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8, std::placeholders::_9), std::bind(&AsyncMqttClient::_onPublish, this, std::placeholders::_1, std::placeholders::_2));
+            _currentParsedPacket = new (&_parser.publish) AsyncMqttClientInternals::PublishPacket(&_parsingInformation, this);
             break;
           case AsyncMqttClientInternals::PacketType.PUBREL:
             log_i("rcv PUBREL");
-            _currentParsedPacket = new AsyncMqttClientInternals::PubRelPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onPubRel, this, std::placeholders::_1));
+            _currentParsedPacket = new (&_parser.pubRel) AsyncMqttClientInternals::PubRelPacket(&_parsingInformation, this);
             break;
           case AsyncMqttClientInternals::PacketType.PUBACK:
             log_i("rcv PUBACK");
-            _currentParsedPacket = new AsyncMqttClientInternals::PubAckPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onPubAck, this, std::placeholders::_1));
+            _currentParsedPacket = new (&_parser.pubAck) AsyncMqttClientInternals::PubAckPacket(&_parsingInformation, this);
             break;
           case AsyncMqttClientInternals::PacketType.PUBREC:
             log_i("rcv PUBREC");
-            _currentParsedPacket = new AsyncMqttClientInternals::PubRecPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onPubRec, this, std::placeholders::_1));
+            _currentParsedPacket = new (&_parser.pubRec) AsyncMqttClientInternals::PubRecPacket(&_parsingInformation, this);
             break;
           case AsyncMqttClientInternals::PacketType.PUBCOMP:
             log_i("rcv PUBCOMP");
-            _currentParsedPacket = new AsyncMqttClientInternals::PubCompPacket(&_parsingInformation, std::bind(&AsyncMqttClient::_onPubComp, this, std::placeholders::_1));
+            _currentParsedPacket = new (&_parser.pubComp) AsyncMqttClientInternals::PubCompPacket(&_parsingInformation, this);
             break;
+          case AsyncMqttClientInternals::PacketType.DISCONNECT:
+            if (_protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0) {
+              log_i("rcv DISCONNECT");
+              _currentParsedPacket = new (&_parser.disconnect) AsyncMqttClientInternals::DisconnectPacket(&_parsingInformation, this);
+              break;
+            }
+            // fall through
           default:
             log_i("rcv PROTOCOL VIOLATION");
-            disconnect(true);
+            _closeConnection(AsyncMqttClientDisconnectReason::MQTT_PROTOCOL_ERROR);
+            _parsingInformation.bufferState = AsyncMqttClientInternals::BufferState::NONE;
+            currentBytePosition = len;  // the rest is not parsed
             break;
         }
         break;
       case AsyncMqttClientInternals::BufferState::REMAINING_LENGTH:
-        currentByte = data[currentBytePosition++];
-        _remainingLengthBuffer[_remainingLengthBufferPosition++] = currentByte;
-        if (currentByte >> 7 == 0) {
+        do {
+          currentByte = data[currentBytePosition++];
+          _remainingLengthBuffer[_remainingLengthBufferPosition++] = currentByte;
+        } while ((currentByte & 0x80) && currentBytePosition < len);
+        if ((currentByte & 0x80) == 0) {
           _parsingInformation.remainingLength = AsyncMqttClientInternals::Helpers::decodeRemainingLength(_remainingLengthBuffer);
           _remainingLengthBufferPosition = 0;
           if (_parsingInformation.remainingLength > 0) {
             _parsingInformation.bufferState = AsyncMqttClientInternals::BufferState::VARIABLE_HEADER;
           } else {
-            // PINGRESP is a special case where it has no variable header, so the packet ends right here
+            // PINGRESP is a special case where it has no variable header, so the packet ends right here,
+            // as does an MQTT 5.0 DISCONNECT for a normal disconnection
             _parsingInformation.bufferState = AsyncMqttClientInternals::BufferState::NONE;
-            _onPingResp();
+            if (_parsingInformation.packetType == AsyncMqttClientInternals::PacketType.DISCONNECT) {
+              _onDisconnectPacket(0);
+            } else {
+              _onPingResp();
+            }
           }
         }
         break;
@@ -328,11 +695,129 @@ void AsyncMqttClient::_onData(char* data, size_t len) {
   } while (currentBytePosition != len);
 }
 
+size_t AsyncMqttClient::_parseInPlace(char* data, size_t len) {
+  // Returns the length of the packet at the start of data, or 0 if it is not
+  // complete or needs the parsers (a malformed one, or an unknown type).
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  uint32_t remainingLength = 0;
+  size_t index = 1;
+  do {
+    if (index >= len || index > 4) return 0;
+    remainingLength |= static_cast<uint32_t>(bytes[index] & 0x7F) << (7 * (index - 1));
+  } while (bytes[index++] & 0x80);
+  if (len - index < remainingLength) return 0;
+
+  uint8_t packetType = bytes[0] >> 4;
+  const uint8_t* body = bytes + index;
+  uint16_t packetId = (remainingLength >= 2) ? (body[0] << 8 | body[1]) : 0;
+  // MQTT 5.0: size of the property section at body + offset, its length included. 0 if it is malformed.
+  bool v5 = _parsingInformation.protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0;
+  auto propertiesSize = [body, remainingLength](size_t offset) -> size_t {
+    uint32_t length = 0;
+    size_t position = offset;
+    do {
+      if (position >= remainingLength || position - offset >= 4) return 0;
+      length |= static_cast<uint32_t>(body[position] & 0x7F) << (7 * (position - offset));
+    } while (body[position++] & 0x80);
+    if (remainingLength - position < length) return 0;
+    return position - offset + length;
+  };
+  switch (packetType) {
+    case AsyncMqttClientInternals::PacketType.CONNACK: {
+      if (remainingLength < 2) return 0;
+      log_i("rcv CONNACK");
+      _client.setRxTimeout(0);
+      // MQTT 5.0 properties, the property length is not needed as they end with the packet
+      size_t position = 2;
+      while (position < remainingLength && (body[position] & 0x80)) position++;
+      AsyncMqttClientInternals::PropertyReader properties;
+      for (position++; position < remainingLength; position++) {
+        if (properties.feed(body[position])) _onConnAckProperty(properties.id(), properties.value());
+      }
+      _onConnAck(body[0] & 0x01, body[1]);
+      break;
+    }
+    case AsyncMqttClientInternals::PacketType.PINGRESP:
+      log_i("rcv PINGRESP");
+      _onPingResp();
+      break;
+    case AsyncMqttClientInternals::PacketType.DISCONNECT:
+      if (!v5) return 0;  // a protocol violation
+      log_i("rcv DISCONNECT");
+      _onDisconnectPacket(remainingLength >= 1 ? body[0] : 0);
+      break;
+    case AsyncMqttClientInternals::PacketType.SUBACK: {
+      size_t codesStart = 2;
+      if (v5) {
+        size_t properties = propertiesSize(2);
+        if (properties == 0) return 0;
+        codesStart += properties;
+      }
+      if (remainingLength <= codesStart) return 0;
+      log_i("rcv SUBACK");
+      _onSubAck(packetId, body + codesStart, remainingLength - codesStart);
+      break;
+    }
+    case AsyncMqttClientInternals::PacketType.UNSUBACK:
+      if (remainingLength < 2) return 0;
+      log_i("rcv UNSUBACK");
+      _onUnsubAck(packetId);
+      break;
+    case AsyncMqttClientInternals::PacketType.PUBREL:
+      if (remainingLength < 2) return 0;
+      log_i("rcv PUBREL");
+      _onPubRel(packetId);
+      break;
+    case AsyncMqttClientInternals::PacketType.PUBACK:
+      if (remainingLength < 2) return 0;
+      log_i("rcv PUBACK");
+      _onPubAck(packetId);
+      break;
+    case AsyncMqttClientInternals::PacketType.PUBREC:
+      if (remainingLength < 2) return 0;
+      log_i("rcv PUBREC");
+      _onPubRec(packetId, (remainingLength > 2) ? body[2] : 0);
+      break;
+    case AsyncMqttClientInternals::PacketType.PUBCOMP:
+      if (remainingLength < 2) return 0;
+      log_i("rcv PUBCOMP");
+      _onPubComp(packetId);
+      break;
+    case AsyncMqttClientInternals::PacketType.PUBLISH: {
+      uint8_t flags = bytes[0] & 0x0F;
+      uint8_t qos = (flags & 0x06) >> 1;
+      if (remainingLength < 2) return 0;
+      uint16_t topicLength = packetId;
+      size_t headerLength = 2 + topicLength + ((qos != 0) ? 2 : 0);
+      if (headerLength > remainingLength) return 0;
+      if (v5) {
+        size_t properties = propertiesSize(headerLength);
+        if (properties == 0) return 0;
+        headerLength += properties;
+      }
+      packetId = (qos != 0) ? (body[2 + topicLength] << 8 | body[3 + topicLength]) : 0;
+      size_t payloadLength = remainingLength - headerLength;
+      log_i("rcv PUBLISH");
+      if (topicLength > _parsingInformation.maxTopicLength) break;  // ignored, like in PublishPacket
+      memcpy(_parsingInformation.topicBuffer, body + 2, topicLength);
+      _parsingInformation.topicBuffer[topicLength] = '\0';
+      _onMessage(_parsingInformation.topicBuffer, (payloadLength > 0) ? data + index + headerLength : nullptr,
+                 qos, flags & AsyncMqttClientInternals::HeaderFlag.PUBLISH_DUP, flags & AsyncMqttClientInternals::HeaderFlag.PUBLISH_RETAIN,
+                 payloadLength, 0, payloadLength, packetId);
+      _onPublish(packetId, qos);
+      break;
+    }
+    default:
+      return 0;
+  }
+  return index + remainingLength;
+}
+
 void AsyncMqttClient::_onPoll() {
   // if there is too much time the client has sent a ping request without a response, disconnect client to avoid half open connections
   if (_lastPingRequestTime != 0 && (millis() - _lastPingRequestTime) >= (_keepAlive * 1000 * 2)) {
     log_w("PING t/o, disconnecting");
-    disconnect(true);
+    _closeConnection(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);  // not disconnect(), the connection was lost rather than ended
     return;
   }
   // send ping to ensure the server will receive at least one message inside keepalive window
@@ -342,98 +827,243 @@ void AsyncMqttClient::_onPoll() {
   } else if (_state == CONNECTED && _lastPingRequestTime == 0 && (millis() - _lastServerActivity) >= (_keepAlive * 1000 * 0.7)) {
     _sendPing();
   }
+  if (_state == CONNECTED && _retransmits()) _handleTimers();
+  if (_state == CONNECTED && !_useIp) _resolve();  // keep the cached addresses fresh for the next connection
+  if (_sessionStore) {
+    SEMAPHORE_TAKE();
+    _sessionStore->sync();
+    SEMAPHORE_GIVE();
+  }
   _handleQueue();
 }
 
 /* QUEUE */
 
-void AsyncMqttClient::_insert(AsyncMqttClientInternals::OutPacket* packet) {
-  // We only use this for QoS2 PUBREL so there must be a PUBLISH packet present.
-  // The queue therefore cannot be empty and _head points to this PUBLISH packet.
-  SEMAPHORE_TAKE();
-  log_i("new insert #%u", packet->packetType());
-  packet->next = _head->next;
-  _head->next = packet;
-  if (_head == _tail) {  // PUB packet is the only one in the queue
-    _tail = packet;
-  }
-  SEMAPHORE_GIVE();
-  _handleQueue();
-}
-
 void AsyncMqttClient::_addFront(AsyncMqttClientInternals::OutPacket* packet) {
   // This is only used for the CONNECT packet, to be able to establish a connection
-  // before anything else. The queue can be empty or has packets from the continued session.
-  // In both cases, _head should always point to the CONNECT packet afterwards.
+  // before anything else. The lanes can be empty or have packets from the continued session.
+  // In both cases, the control lane should always start with the CONNECT packet afterwards.
   SEMAPHORE_TAKE();
   log_i("new front #%u", packet->packetType());
-  if (_head == nullptr) {
-    _tail = packet;
-  } else {
-    packet->next = _head;
-  }
-  _head = packet;
+  AsyncMqttClientInternals::OutLane& lane = _lanes[CONTROL_LANE];
+  packet->sequence = _nextSequence++;
+  _queuedBytes += packet->size();
+  _queuedPackets++;
+  packet->next = lane.head;
+  if (!lane.head) lane.tail = packet;
+  lane.head = packet;
   SEMAPHORE_GIVE();
   _handleQueue();
 }
 
+bool AsyncMqttClient::_canQueue() const {
+  return _state == CONNECTED || (_state == CONNECTING && _pipelineConnect);
+}
+
 void AsyncMqttClient::_addBack(AsyncMqttClientInternals::OutPacket* packet) {
   SEMAPHORE_TAKE();
   log_i("new back #%u", packet->packetType());
-  if (!_tail) {
-    _head = packet;
-  } else {
-    _tail->next = packet;
+  if (_sessionStore && packet->persistent()) {
+    _journal(AsyncMqttClientInternals::SessionRecord.PUBLISH, packet->packetId(), packet);
   }
-  _tail = packet;
-  _tail->next = nullptr;
+  _enqueue(packet);
   SEMAPHORE_GIVE();
   _handleQueue();
 }
 
+void AsyncMqttClient::_enqueue(AsyncMqttClientInternals::OutPacket* packet) {
+  AsyncMqttClientInternals::OutLane& lane = _lanes[_laneOf(packet)];
+  packet->sequence = _nextSequence++;
+  _queuedBytes += packet->size();
+  _queuedPackets++;
+  packet->next = nullptr;
+  if (!lane.tail) {
+    lane.head = packet;
+  } else {
+    lane.tail->next = packet;
+  }
+  lane.tail = packet;
+}
+
+uint8_t AsyncMqttClient::_laneOf(const AsyncMqttClientInternals::OutPacket* packet) const {
+  uint8_t packetType = packet->packetType();
+  if (packetType == AsyncMqttClientInternals::PacketType.PUBLISH) {
+    return (packet->qos() > 0) ? QOS_LANE : QOS0_LANE;
+  } else if (packetType == AsyncMqttClientInternals::PacketType.SUBSCRIBE ||
+             packetType == AsyncMqttClientInternals::PacketType.UNSUBSCRIBE) {
+    return QOS_LANE;
+  } else if (packetType == AsyncMqttClientInternals::PacketType.DISCONNECT) {
+    return QOS0_LANE;
+  }
+  return CONTROL_LANE;
+}
+
+uint8_t AsyncMqttClient::_nextLane() const {
+  const AsyncMqttClientInternals::OutPacket* control = _lanes[CONTROL_LANE].head;
+  const AsyncMqttClientInternals::OutPacket* qos0 = _lanes[QOS0_LANE].head;
+  const AsyncMqttClientInternals::OutPacket* qos = _lanes[QOS_LANE].head;
+
+  // hold the session until CONNACK, unless it is pipelined right behind CONNECT
+  if (_state == CONNECTING) {
+    if (control && control->packetType() == AsyncMqttClientInternals::PacketType.CONNECT) return CONTROL_LANE;
+    if (!_pipelineConnect) return LANES;
+  }
+  // acks and pings never wait behind data
+  if (control) return CONTROL_LANE;
+
+  // QoS>0 messages wait for a free in-flight slot, (UN)SUBSCRIBE for one among those waiting for their ack.
+  // Without pipelining, everything waits for the ack of a (UN)SUBSCRIBE sent before.
+  bool qosReady = qos && (_maxPendingSubAcks > 1 || _pendingSubAcks.empty()) && _hasInflightSlot(qos);
+  if (qos0 && qos0->packetType() == AsyncMqttClientInternals::PacketType.DISCONNECT && qos) {
+    return qosReady ? QOS_LANE : LANES;  // DISCONNECT goes after everything queued before it
+  }
+  // otherwise keep the order of the calls, QoS 0 only bypasses QoS>0 messages that have to wait
+  if (qos0 && qosReady) {
+    return (static_cast<int32_t>(qos0->sequence - qos->sequence) < 0) ? QOS0_LANE : QOS_LANE;
+  }
+  if (qos0) return QOS0_LANE;
+  if (qosReady) return QOS_LANE;
+  return LANES;
+}
+
 void AsyncMqttClient::_handleQueue() {
   SEMAPHORE_TAKE();
   // On ESP32, onDisconnect is called within the close()-call. So we need to make sure we don't lock
   bool disconnect = false;
+  // When coalescing, data is only pushed once the queue is stuck or the threshold/deadline is reached
+  bool flush = false;
+  bool writable = false;
+  std::vector<AsyncMqttClientInternals::OutPacket*> oversized;  // deleted outside the lock, it may call user code
+
+  while (_client.space() > 10) {  // safe but arbitrary value, send at least 10 bytes
+    // 0. pick the lane to send from, a packet in progress is always completed first
+    if (_sent == 0) {
+      _sendingLane = _nextLane();
+      if (_sendingLane == LANES) {
+        // nothing can be sent right now, push what we have if packets are waiting
+        if (_lanes[CONTROL_LANE].head || _lanes[QOS0_LANE].head || _lanes[QOS_LANE].head) flush = true;
+        break;
+      }
+    }
+    AsyncMqttClientInternals::OutLane& lane = _lanes[_sendingLane];
+    AsyncMqttClientInternals::OutPacket* packet = lane.head;
+    if (_sent == 0) {
+      _prepareProperties(packet);
+      if (_serverMaximumPacketSize > 0 && packet->size() > _serverMaximumPacketSize) {
+        // the server would close the connection on it
+        log_w("p #%u too large (%u)", packet->packetType(), packet->size());
+        _unlink(packet);
+        _disarmTimer(packet);
+        auto it = std::find(_inflight.begin(), _inflight.end(), packet);
+        if (it != _inflight.end()) _inflight.erase(it);
+        _releasePacketId(packet);
+        if (_sessionStore && packet->qos() > 0) _journal(AsyncMqttClientInternals::SessionRecord.COMPLETED, packet->packetId());
+        _stats.rejected++;
+        oversized.push_back(packet);
+        continue;
+      }
+    }
 
-  while (_head && _client.space() > 10) {  // safe but arbitrary value, send at least 10 bytes
     // 1. try to send
-    if (_head->size() > _sent) {
+    if (packet->size() > _sent) {
       // On SSL the TCP library returns the total amount of bytes, not just the unencrypted payload length.
       // So we calculate the amount to be written ourselves.
-      size_t willSend = std::min(_head->size() - _sent, _client.space());
-      size_t realSent = _client.add(reinterpret_cast<const char*>(_head->data(_sent)), willSend, ASYNC_WRITE_FLAG_COPY);  // flag is set by LWIP anyway, added for clarity
+      // Caller-owned payloads are not copied, LWIP references them until they are acked.
+      size_t willSend = packet->pull(_sent, _client.space());
+      if (willSend == 0) {
+        flush = true;  // streamed payload not ready yet, retried on the next ack or poll
+        break;
+      }
+      uint8_t flags = packet->ownsData(_sent) ? ASYNC_WRITE_FLAG_COPY : 0;
+      size_t realSent = _client.add(reinterpret_cast<const char*>(packet->data(_sent)), willSend, flags);
       _sent += willSend;
+      _bytesSent += willSend;
       (void)realSent;
-      _client.send();
+      if (_unflushed == 0) {
+        _unflushedSince = millis();
+        if (_coalesceThreshold > 0 && _coalesceDeadline > 0) _armFlush();
+      }
+      _unflushed += willSend;
+      if (_coalesceThreshold == 0) {
+        _client.send();
+        _stats.segmentsSent++;
+        _unflushed = 0;
+      }
       _lastClientActivity = millis();
       _lastPingRequestTime = 0;
       #if ASYNC_TCP_SSL_ENABLED
-      log_i("snd #%u: (tls: %u) %u/%u", _head->packetType(), realSent, _sent, _head->size());
+      log_i("snd #%u: (tls: %u) %u/%u", packet->packetType(), realSent, _sent, packet->size());
       #else
-      log_i("snd #%u: %u/%u", _head->packetType(), _sent, _head->size());
+      log_i("snd #%u: %u/%u", packet->packetType(), _sent, packet->size());
       #endif
-      if (_head->packetType() == AsyncMqttClientInternals::PacketType.DISCONNECT) {
+      if (packet->packetType() == AsyncMqttClientInternals::PacketType.DISCONNECT) {
         disconnect = true;
       }
+      if (packet->size() == _sent) {
+        _stats.packetsSent++;
+        // keep the connection handshake and keepalive latency low
+        if (packet->packetType() == AsyncMqttClientInternals::PacketType.CONNECT ||
+            packet->packetType() == AsyncMqttClientInternals::PacketType.PINGREQ ||
+            packet->packetType() == AsyncMqttClientInternals::PacketType.DISCONNECT) {
+          flush = true;
+        }
+      }
     }
 
-    // 2. stop processing when we have to wait for an MQTT acknowledgment
-    if (_head->size() == _sent) {
-      if (_head->released()) {
-        log_i("p #%d rel", _head->packetType());
-        AsyncMqttClientInternals::OutPacket* tmp = _head;
-        _head = _head->next;
-        if (!_head) _tail = nullptr;
-        delete tmp;
-        _sent = 0;
+    // 2. once sent, move QoS>0 flows to the in-flight table and (UN)SUBSCRIBE aside until acknowledged
+    if (packet->size() == _sent) {
+      lane.head = packet->next;
+      if (!lane.head) lane.tail = nullptr;
+      packet->next = nullptr;
+      _sent = 0;
+      _queuedBytes -= packet->size();
+      _queuedPackets--;
+      if (packet->released()) {
+        log_i("p #%d rel", packet->packetType());
+        if (!packet->ownsData(packet->size() - 1)) {
+          // the payload is caller-owned, keep the packet until TCP acked it
+          AsyncMqttClientInternals::PendingTcpAck pendingTcpAck;
+          pendingTcpAck.packet = packet;
+          pendingTcpAck.ackedAt = _bytesSent;
+#if ASYNC_TCP_SSL_ENABLED
+          if (_secure) pendingTcpAck.ackedAt = _bytesAcked;  // already copied when encrypted
+#endif
+          _pendingTcpAcks.push_back(pendingTcpAck);
+        } else {
+          delete packet;
+        }
+      } else if (_addInflight(packet)) {
+        log_i("p #%d in-flight (%u)", packet->packetType(), _inflight.size());
+        if (_retransmits()) _armTimer(packet);
       } else {
-        break;  // sending is complete however send next only after mqtt confirmation
+        _pendingSubAcks.push_back(packet);
+        flush = true;
       }
     }
   }
+  if (_client.space() <= 10) flush = true;  // TCP send buffer is full
+  writable = _writableAgain();  // the queue drained, or the ack which led here freed a packet ID
+
+  if (_unflushed > 0 &&
+      (flush || _unflushed >= _coalesceThreshold || millis() - _unflushedSince >= _coalesceDeadline)) {
+    log_i("flush %u", _unflushed);
+    _client.send();
+    _stats.segmentsSent++;
+    _unflushed = 0;
+  }
 
   SEMAPHORE_GIVE();
+#if ASYNC_TCP_SSL_ENABLED
+  if (_secure) _releaseTcpAcked(false);
+#endif
+  for (AsyncMqttClientInternals::OutPacket* packet : oversized) {
+    uint16_t packetId = packet->packetId();
+    delete packet;
+    for (const auto& callback : _onErrorUserCallbacks) callback(packetId, AsyncMqttClientError::PACKET_TOO_LARGE);
+  }
+  if (writable) {
+    for (const auto& callback : _onWritableUserCallbacks) callback();
+  }
   if (disconnect) {
     log_i("snd DISCONN, disconnecting");
     _client.close();
@@ -441,54 +1071,507 @@ void AsyncMqttClient::_handleQueue() {
 }
 
 void AsyncMqttClient::_clearQueue(bool keepSessionData) {
+  std::vector<AsyncMqttClientInternals::OutPacket*> queued;
+  AsyncMqttClientInternals::OutPacket* discarded = nullptr;  // deleted outside the lock, it may call user code
+  auto discard = [this, &discarded](AsyncMqttClientInternals::OutPacket* packet) {
+    _releasePacketId(packet);
+    packet->next = discarded;
+    discarded = packet;
+  };
+
   SEMAPHORE_TAKE();
-  AsyncMqttClientInternals::OutPacket* packet = _head;
-  _head = nullptr;
-  _tail = nullptr;
-
-  while (packet) {
-    /* MQTT spec 3.1.2.4 Clean Session:
-     *  - QoS 1 and QoS 2 messages which have been sent to the Server, but have not been completely acknowledged.
-     *  - QoS 2 messages which have been received from the Server, but have not been completely acknowledged.
-     * + (unsent PUB messages with QoS > 0)
-     * 
-     * To be kept:
-     * - possibly first message (sent to server but not acked)
-     * - PUBREC messages (QoS 2 PUB received but not acked)
-     * - PUBCOMP messages (QoS 2 PUBREL received but not acked)
-     */
+  for (AsyncMqttClientInternals::OutLane& lane : _lanes) {
+    for (AsyncMqttClientInternals::OutPacket* packet = lane.head; packet; packet = packet->next) {
+      queued.push_back(packet);
+    }
+    lane.head = nullptr;
+    lane.tail = nullptr;
+  }
+  _queuedBytes = 0;  // recounted for the packets kept below
+  _queuedPackets = 0;
+  // (UN)SUBSCRIBE made or pipelined before the connection was accepted never reached the broker
+  bool requeueSubscriptions = keepSessionData && _awaitingConnAck;
+  for (AsyncMqttClientInternals::OutPacket* packet : _pendingSubAcks) {
+    if (!requeueSubscriptions) discard(packet);
+  }
+
+  /* MQTT spec 3.1.2.4 Clean Session:
+   *  - QoS 1 and QoS 2 messages which have been sent to the Server, but have not been completely acknowledged.
+   *  - QoS 2 messages which have been received from the Server, but have not been completely acknowledged.
+   * + (unsent PUB messages with QoS > 0)
+   *
+   * To be kept:
+   * - in-flight messages (sent to server but not acked), in the order they were sent
+   * - PUBREL messages (QoS 2 PUBREC received but not completed)
+   * - PUBREC messages (QoS 2 PUB received but not acked)
+   * - PUBCOMP messages (QoS 2 PUBREL received but not acked)
+   */
+  _clearTimers();
+  for (AsyncMqttClientInternals::OutPacket* inflight : _inflight) {
+    inflight->noTries = 0;  // a new connection starts with a new retry budget
     if (keepSessionData) {
-      if (packet->qos() > 0 && packet->size() <= _sent) {  // check for qos includes check for PUB-packet type
-        reinterpret_cast<AsyncMqttClientInternals::PublishOutPacket*>(packet)->setDup();
-        AsyncMqttClientInternals::OutPacket* next = packet->next;
-        log_i("keep #%u", packet->packetType());
-        SEMAPHORE_GIVE();
-        _addBack(packet);
-        SEMAPHORE_TAKE();
-        packet = next;
-      } else if (packet->qos() > 0 ||
-                 packet->packetType() == AsyncMqttClientInternals::PacketType.PUBREC ||
-                 packet->packetType() == AsyncMqttClientInternals::PacketType.PUBCOMP) {
-        AsyncMqttClientInternals::OutPacket* next = packet->next;
-        log_i("keep #%u", packet->packetType());
-        SEMAPHORE_GIVE();
-        _addBack(packet);
-        SEMAPHORE_TAKE();
-        packet = next;
-      } else {
-        AsyncMqttClientInternals::OutPacket* next = packet->next;
-        delete packet;
-        packet = next;
+      if (inflight->packetType() == AsyncMqttClientInternals::PacketType.PUBLISH) {
+        reinterpret_cast<AsyncMqttClientInternals::PublishOutPacket*>(inflight)->setDup();
       }
-    /* Delete everything when not keeping session data
-     */
+      log_i("keep #%u", inflight->packetType());
+      _enqueue(inflight);
     } else {
-      AsyncMqttClientInternals::OutPacket* next = packet->next;
-      delete packet;
-      packet = next;
+      discard(inflight);
+    }
+  }
+
+  if (requeueSubscriptions) {
+    for (AsyncMqttClientInternals::OutPacket* packet : _pendingSubAcks) {
+      log_i("keep #%u", packet->packetType());
+      _enqueue(packet);
     }
   }
+  _pendingSubAcks.clear();
+
+  for (AsyncMqttClientInternals::OutPacket* packet : queued) {
+    // a PUBREL waiting to be sent already holds its in-flight slot and was handled above
+    if (std::find(_inflight.begin(), _inflight.end(), packet) != _inflight.end()) continue;
+    if (keepSessionData &&
+        ((packet->qos() > 0 && !packet->released()) ||  // check for qos includes check for PUB-packet type
+         packet->packetType() == AsyncMqttClientInternals::PacketType.PUBREL ||
+         packet->packetType() == AsyncMqttClientInternals::PacketType.PUBREC ||
+         packet->packetType() == AsyncMqttClientInternals::PacketType.PUBCOMP ||
+         (requeueSubscriptions && _laneOf(packet) == QOS_LANE))) {
+      log_i("keep #%u", packet->packetType());
+      _enqueue(packet);
+    } else {
+      discard(packet);
+    }
+  }
+  _inflight.clear();
   _sent = 0;
+  _sendingLane = LANES;
+  bool writable = _writableAgain();
+  SEMAPHORE_GIVE();
+
+  while (discarded) {
+    AsyncMqttClientInternals::OutPacket* next = discarded->next;
+    delete discarded;
+    discarded = next;
+  }
+  if (writable) {
+    for (const auto& callback : _onWritableUserCallbacks) callback();
+  }
+}
+
+bool AsyncMqttClient::_admit(size_t size) {
+  AsyncMqttClientError error;
+  if (GET_FREE_MEMORY() < MQTT_MIN_FREE_MEMORY) {
+    error = AsyncMqttClientError::OUT_OF_MEMORY;
+  } else if ((_maxQueueBytes > 0 && _queuedBytes + size > _maxQueueBytes) ||
+             (_maxQueuePackets > 0 && _queuedPackets >= _maxQueuePackets)) {
+    error = AsyncMqttClientError::QUEUE_FULL;
+    _writableWanted = true;
+  } else {
+    return true;
+  }
+  log_i("PUBLISH refused (%u)", static_cast<uint8_t>(error));
+  _stats.rejected++;
+  for (const auto& callback : _onErrorUserCallbacks) callback(0, error);
+  return false;
+}
+
+bool AsyncMqttClient::_belowLowWater() const {
+  // the low-water mark is half of each budget
+  return (_maxQueueBytes == 0 || _queuedBytes <= _maxQueueBytes / 2) &&
+         (_maxQueuePackets == 0 || _queuedPackets <= _maxQueuePackets / 2);
+}
+
+bool AsyncMqttClient::_writableAgain() {
+  // notify once whatever refused a message is available again
+  if (!_writableWanted && !_packetIdWanted) return false;
+  if (_writableWanted && !_belowLowWater()) return false;
+  if (_packetIdWanted && _packetIds.used() >= MQTT_PACKET_ID_WINDOW) return false;
+  _writableWanted = false;
+  _packetIdWanted = false;
+  return true;
+}
+
+uint16_t AsyncMqttClient::_allocatePacketId() {
+  SEMAPHORE_TAKE();
+  uint16_t packetId = _packetIds.allocate();
+  if (packetId == 0) _packetIdWanted = true;
+  SEMAPHORE_GIVE();
+  if (packetId == 0) {
+    // every ID of the window is held by a flow in progress, they free up with the acks
+    log_i("no packet ID available (%u used)", _packetIds.used());
+    _stats.rejected++;
+    for (const auto& callback : _onErrorUserCallbacks) callback(0, AsyncMqttClientError::NO_PACKET_ID);
+  }
+  return packetId;
+}
+
+void AsyncMqttClient::_releasePacketId(const AsyncMqttClientInternals::OutPacket* packet) {
+  // a released PUBLISH gave its ID back on its ack already, a released PUBREL answers a stray PUBREC
+  if (packet->released()) return;
+  uint8_t packetType = packet->packetType();
+  if (packet->qos() > 0 ||
+      packetType == AsyncMqttClientInternals::PacketType.PUBREL ||
+      packetType == AsyncMqttClientInternals::PacketType.SUBSCRIBE ||
+      packetType == AsyncMqttClientInternals::PacketType.UNSUBSCRIBE) {
+    _packetIds.release(packet->packetId());
+  }
+}
+
+void AsyncMqttClient::_releaseTcpAcked(bool all) {
+  // Packets are released one by one outside the lock, the release callback may publish again.
+  while (true) {
+    AsyncMqttClientInternals::OutPacket* packet = nullptr;
+    SEMAPHORE_TAKE();
+    if (!_pendingTcpAcks.empty() &&
+        (all || static_cast<int32_t>(_bytesAcked - _pendingTcpAcks.front().ackedAt) >= 0)) {
+      packet = _pendingTcpAcks.front().packet;
+      _pendingTcpAcks.erase(_pendingTcpAcks.begin());
+    }
+    SEMAPHORE_GIVE();
+    if (!packet) break;
+    delete packet;
+  }
+}
+
+/* IN-FLIGHT */
+
+bool AsyncMqttClient::_hasInflightSlot(const AsyncMqttClientInternals::OutPacket* packet) const {
+  if (packet->released()) return true;
+  if (packet->packetType() != AsyncMqttClientInternals::PacketType.PUBLISH &&
+      packet->packetType() != AsyncMqttClientInternals::PacketType.PUBREL) {
+    return _pendingSubAcks.size() < _maxPendingSubAcks;  // SUBSCRIBE or UNSUBSCRIBE
+  }
+  // a retransmission, or a PUBREL continuing a QoS 2 flow, already holds a slot
+  if (std::find(_inflight.begin(), _inflight.end(), packet) != _inflight.end()) return true;
+  return _inflight.size() < _maxInflight && _inflight.size() < _serverReceiveMaximum;
+}
+
+bool AsyncMqttClient::_addInflight(AsyncMqttClientInternals::OutPacket* packet) {
+  if (packet->packetType() != AsyncMqttClientInternals::PacketType.PUBLISH &&
+      packet->packetType() != AsyncMqttClientInternals::PacketType.PUBREL) {
+    return false;
+  }
+  if (std::find(_inflight.begin(), _inflight.end(), packet) != _inflight.end()) return true;
+  if (_inflight.size() >= _maxInflight) return false;
+  _inflight.push_back(packet);
+  return true;
+}
+
+AsyncMqttClientInternals::OutPacket* AsyncMqttClient::_takePendingSubAck(uint8_t packetType, uint16_t packetId) {
+  for (auto it = _pendingSubAcks.begin(); it != _pendingSubAcks.end(); ++it) {
+    if ((*it)->packetId() == packetId && (*it)->packetType() == packetType) {
+      AsyncMqttClientInternals::OutPacket* packet = *it;
+      _pendingSubAcks.erase(it);
+      return packet;
+    }
+  }
+  return nullptr;
+}
+
+AsyncMqttClientInternals::OutPacket* AsyncMqttClient::_findInflight(uint8_t packetType, uint16_t packetId) {
+  for (AsyncMqttClientInternals::OutPacket* inflight : _inflight) {
+    if (inflight->packetId() == packetId && inflight->packetType() == packetType) {
+      return inflight;
+    }
+  }
+  return nullptr;
+}
+
+bool AsyncMqttClient::_takeInflight(AsyncMqttClientInternals::OutPacket* packet) {
+  std::vector<AsyncMqttClientInternals::OutPacket*>::iterator it = std::find(_inflight.begin(), _inflight.end(), packet);
+  if (it == _inflight.end()) return false;
+  _inflight.erase(it);
+  return _forget(packet);
+}
+
+/* RETRANSMISSION */
+
+void AsyncMqttClient::_armTimer(AsyncMqttClientInternals::OutPacket* packet) {
+  // the delay doubles with every transmission, up to the maximum
+  uint32_t delay = _retransmitTimeout;
+  for (uint8_t i = 0; i < packet->noTries && delay < _retransmitMaxTimeout; i++) delay *= 2;
+  if (delay > _retransmitMaxTimeout) delay = _retransmitMaxTimeout;
+  if (delay < MQTT_RETRANSMIT_TICK) delay = MQTT_RETRANSMIT_TICK;  // not before the next tick
+  packet->noTries++;
+  packet->timeout = millis() + delay;
+  if (packet->timeout == 0) packet->timeout = 1;  // 0 means unarmed
+
+  AsyncMqttClientInternals::OutPacket*& slot = _timerWheel[(packet->timeout / MQTT_RETRANSMIT_TICK) % MQTT_RETRANSMIT_SLOTS];
+  packet->nextTimer = slot;
+  slot = packet;
+}
+
+void AsyncMqttClient::_disarmTimer(AsyncMqttClientInternals::OutPacket* packet) {
+  if (packet->timeout == 0) return;
+  AsyncMqttClientInternals::OutPacket** it = &_timerWheel[(packet->timeout / MQTT_RETRANSMIT_TICK) % MQTT_RETRANSMIT_SLOTS];
+  while (*it && *it != packet) it = &(*it)->nextTimer;
+  if (*it) *it = packet->nextTimer;
+  packet->nextTimer = nullptr;
+  packet->timeout = 0;
+}
+
+void AsyncMqttClient::_clearTimers() {
+  for (AsyncMqttClientInternals::OutPacket*& slot : _timerWheel) {
+    while (slot) {
+      AsyncMqttClientInternals::OutPacket* packet = slot;
+      slot = packet->nextTimer;
+      packet->nextTimer = nullptr;
+      packet->timeout = 0;
+    }
+  }
+}
+
+bool AsyncMqttClient::_forget(AsyncMqttClientInternals::OutPacket* packet) {
+  // Stop retransmitting a packet which left the in-flight table. Returns false
+  // if it is being written to TCP: it is then released and deleted once written.
+  // Also false if TCP may still hold a retransmitted caller-owned payload: the
+  // ack can answer the first copy, the packet is deleted once TCP acked the rest.
+  _disarmTimer(packet);
+  if (packet->noTries == 0) return true;  // never queued again
+  AsyncMqttClientInternals::OutLane& lane = _lanes[_laneOf(packet)];
+  if (_sent > 0 && lane.head == packet && _sendingLane == _laneOf(packet)) {
+    packet->release();
+    return false;
+  }
+  _unlink(packet);
+  if (packet->noTries > 1 && !packet->ownsData(packet->size() - 1)) {
+    AsyncMqttClientInternals::PendingTcpAck pendingTcpAck;
+    pendingTcpAck.packet = packet;
+    pendingTcpAck.ackedAt = _bytesSent;
+#if ASYNC_TCP_SSL_ENABLED
+    if (_secure) pendingTcpAck.ackedAt = _bytesAcked;  // already copied when encrypted
+#endif
+    if (static_cast<int32_t>(_bytesAcked - pendingTcpAck.ackedAt) >= 0) return true;
+    _pendingTcpAcks.push_back(pendingTcpAck);
+    return false;
+  }
+  return true;
+}
+
+void AsyncMqttClient::_requeue(AsyncMqttClientInternals::OutPacket* packet) {
+  // at the front of its lane, behind a packet partially written to TCP
+  uint8_t laneIndex = _laneOf(packet);
+  AsyncMqttClientInternals::OutLane& lane = _lanes[laneIndex];
+  AsyncMqttClientInternals::OutPacket** it = &lane.head;
+  if (_sent > 0 && _sendingLane == laneIndex) it = &lane.head->next;
+  packet->next = *it;
+  *it = packet;
+  if (!packet->next) lane.tail = packet;
+  _queuedBytes += packet->size();
+  _queuedPackets++;
+}
+
+bool AsyncMqttClient::_unlink(AsyncMqttClientInternals::OutPacket* packet) {
+  AsyncMqttClientInternals::OutLane& lane = _lanes[_laneOf(packet)];
+  AsyncMqttClientInternals::OutPacket* previous = nullptr;
+  for (AsyncMqttClientInternals::OutPacket* it = lane.head; it; previous = it, it = it->next) {
+    if (it != packet) continue;
+    if (previous) {
+      previous->next = packet->next;
+    } else {
+      lane.head = packet->next;
+    }
+    if (lane.tail == packet) lane.tail = previous;
+    packet->next = nullptr;
+    _queuedBytes -= packet->size();
+    _queuedPackets--;
+    return true;
+  }
+  return false;
+}
+
+bool AsyncMqttClient::_retransmits() const {
+  // MQTT 5.0 forbids resending a message on a live connection [MQTT-4.4.0-1]
+  return _retransmitTimeout > 0 && _protocolLevel != AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0;
+}
+
+void AsyncMqttClient::_handleTimers() {
+  std::vector<AsyncMqttClientInternals::OutPacket*> exhausted;  // deleted outside the lock, it may call user code
+
+  SEMAPHORE_TAKE();
+  uint32_t now = millis();
+  uint32_t tick = now / MQTT_RETRANSMIT_TICK;
+  // visit the slots of the ticks elapsed since the last poll, every slot at most once
+  uint32_t elapsed = tick - _timerTick;
+  if (elapsed > MQTT_RETRANSMIT_SLOTS) elapsed = MQTT_RETRANSMIT_SLOTS;
+  for (uint32_t i = elapsed; i > 0; i--) {
+    AsyncMqttClientInternals::OutPacket** it = &_timerWheel[(tick - i + 1) % MQTT_RETRANSMIT_SLOTS];
+    while (*it) {
+      AsyncMqttClientInternals::OutPacket* packet = *it;
+      if (static_cast<int32_t>(now - packet->timeout) < 0) {  // due in a later round of the wheel
+        it = &packet->nextTimer;
+        continue;
+      }
+      *it = packet->nextTimer;
+      packet->nextTimer = nullptr;
+      packet->timeout = 0;
+      if (packet->noTries > _maxRetries) {
+        log_w("p #%u %u retries exhausted", packet->packetType(), packet->packetId());
+        auto inflight = std::find(_inflight.begin(), _inflight.end(), packet);
+        if (inflight != _inflight.end()) _inflight.erase(inflight);
+        _packetIds.release(packet->packetId());
+        if (_sessionStore) _journal(AsyncMqttClientInternals::SessionRecord.COMPLETED, packet->packetId());
+        exhausted.push_back(packet);
+      } else {
+        log_i("p #%u %u retransmit", packet->packetType(), packet->packetId());
+        if (packet->packetType() == AsyncMqttClientInternals::PacketType.PUBLISH) {
+          reinterpret_cast<AsyncMqttClientInternals::PublishOutPacket*>(packet)->setDup();
+        }
+        _requeue(packet);
+      }
+    }
+  }
+  _timerTick = tick;
+  SEMAPHORE_GIVE();
+
+  for (AsyncMqttClientInternals::OutPacket* packet : exhausted) {
+    uint16_t packetId = packet->packetId();
+    delete packet;
+    for (const auto& callback : _onErrorUserCallbacks) callback(packetId, AsyncMqttClientError::MAX_RETRIES);
+  }
+}
+
+/* SERVERS */
+
+void AsyncMqttClient::_pickServer() {
+  const AsyncMqttClientInternals::ServerEndpoint& server = _servers.current();
+  if (!server.is(_ip, _useIp ? nullptr : _host, _port)) {
+    _dnsIndex = -1;
+    _dnsAttempt = 0;
+  }
+  _ip = server.ip;
+  _host = server.host;
+  _useIp = server.host == nullptr;
+  _port = server.port;
+}
+
+/* DNS */
+
+void AsyncMqttClient::_resolve() {
+  // look the host up in the background, unless the cached addresses are fresh
+  AsyncMqttClientInternals::DnsLookup* lookup = nullptr;
+  SEMAPHORE_TAKE();
+  _takeResolved();
+  if (!_dnsLookup && _servers.current().dns.stale(millis())) {
+    lookup = new AsyncMqttClientInternals::DnsLookup(this, _host);
+    _dnsLookup = lookup;
+  }
+  SEMAPHORE_GIVE();
+  if (!lookup) return;
+
+  inLwipThread([](void* arg) {
+    auto found = [](const char* host, const ip_addr_t* address, void* arg) {
+      // In the lwIP thread, which must not wait for the client lock: the client
+      // may hold it while it waits for this thread to send.
+      AsyncMqttClientInternals::DnsLookup* lookup = static_cast<AsyncMqttClientInternals::DnsLookup*>(arg);
+      if (!lookup->client) {
+        delete lookup;  // the client is gone
+        return;
+      }
+      lookup->found = address != nullptr && IP_IS_V4(address);
+      if (lookup->found) lookup->address = IPAddress(ip4_addr_get_u32(ip_2_ip4(address)));
+      lookup->answered.store(true, std::memory_order_release);
+    };
+    AsyncMqttClientInternals::DnsLookup* lookup = static_cast<AsyncMqttClientInternals::DnsLookup*>(arg);
+    ip_addr_t address;
+    err_t err = dns_gethostbyname(lookup->host.c_str(), &address, found, lookup);
+    if (err == ERR_OK) {
+      found(lookup->host.c_str(), &address, lookup);  // in the lwIP table already
+    } else if (err != ERR_INPROGRESS) {
+      found(lookup->host.c_str(), nullptr, lookup);
+    }
+  }, lookup);
+}
+
+void AsyncMqttClient::_cancelResolve() {
+  // The answer comes in the lwIP thread: detaching from there cannot race with it.
+  inLwipThread([](void* arg) {
+    AsyncMqttClient* client = static_cast<AsyncMqttClient*>(arg);
+    AsyncMqttClientInternals::DnsLookup* lookup = client->_dnsLookup;
+    if (!lookup) return;
+    if (lookup->answered.load(std::memory_order_acquire)) {
+      delete lookup;
+    } else {
+      lookup->client = nullptr;  // freed by its answer
+    }
+    client->_dnsLookup = nullptr;
+  }, this);
+}
+
+void AsyncMqttClient::_takeResolved() {
+  // with the lock held: the answer of a finished lookup goes to the cache of its server
+  if (!_dnsLookup || !_dnsLookup->answered.load(std::memory_order_acquire)) return;
+  log_i("DNS %s: %d", _dnsLookup->host.c_str(), _dnsLookup->found);
+  // the server may have changed meanwhile
+  AsyncMqttClientInternals::ServerEndpoint* server = _servers.find(_dnsLookup->host.c_str());
+  if (_dnsLookup->found && server) server->dns.add(_dnsLookup->address, millis());
+  delete _dnsLookup;
+  _dnsLookup = nullptr;
+}
+
+/* RECONNECT */
+
+void AsyncMqttClient::_scheduleReconnect(bool wasConnected) {
+  uint32_t delay;
+  if (wasConnected && millis() - _connectedSince >= _reconnectStablePeriod) {
+    // A connection which held was reset: the backoff starts over and the first
+    // attempt is almost immediate, spread over the minimum delay so that clients
+    // dropped together by a broker restart do not come back in lockstep.
+    _reconnectDelay = _reconnectMinDelay;
+    delay = random(_reconnectMinDelay);
+  } else {
+    // decorrelated jitter: anywhere between the minimum and three times the last delay, capped
+    uint32_t upper = (_reconnectDelay > _reconnectMaxDelay / 3) ? _reconnectMaxDelay : _reconnectDelay * 3;
+    _reconnectDelay = (upper > _reconnectMinDelay) ? random(_reconnectMinDelay, upper + 1) : _reconnectMinDelay;
+    delay = _reconnectDelay;
+  }
+  log_i("reconnect in %u ms", delay);
+#if defined(ESP32)
+  TickType_t ticks = pdMS_TO_TICKS(delay);
+  xTimerChangePeriod(_reconnectTimer, (ticks > 0) ? ticks : 1, 0);  // also starts it
+#elif defined(ESP8266)
+  _reconnectTimer.once_ms(delay, _onReconnectTimer, this);
+#endif
+}
+
+void AsyncMqttClient::_cancelReconnect() {
+#if defined(ESP32)
+  if (_reconnectTimer) xTimerStop(_reconnectTimer, 0);  // may run in the timer task, never block
+#elif defined(ESP8266)
+  _reconnectTimer.detach();
+#endif
+}
+
+void AsyncMqttClient::_onReconnectTimer(AsyncMqttClient* client) {
+  if (!client->_reconnectWanted || client->_state != DISCONNECTED) return;
+  log_i("reconnecting");
+  client->_stats.reconnectAttempts++;
+  client->connect();
+}
+
+void AsyncMqttClient::_armFlush() {
+#if defined(ESP32)
+  TickType_t ticks = pdMS_TO_TICKS(_coalesceDeadline);
+  xTimerChangePeriod(_flushTimer, (ticks > 0) ? ticks : 1, 0);  // also restarts it
+#elif defined(ESP8266)
+  _flushTimer.once_ms(_coalesceDeadline, _onFlushTimer, this);
+#endif
+}
+
+void AsyncMqttClient::_onFlushTimer(AsyncMqttClient* client) {
+  client->_flush();
+}
+
+void AsyncMqttClient::_flush() {
+  // pending bytes are pushed at their deadline even when no further packet or poll comes
+  SEMAPHORE_TAKE();
+  if (_unflushed > 0) {
+    log_i("flush %u (deadline)", _unflushed);
+    _client.send();
+    _stats.segmentsSent++;
+    _unflushed = 0;
+  }
   SEMAPHORE_GIVE();
 }
 
@@ -496,6 +1579,13 @@ void AsyncMqttClient::_clearQueue(bool keepSessionData) {
 void AsyncMqttClient::_onPingResp() {
   log_i("PINGRESP");
   _freeCurrentParsedPacket();
+  if (_pingSentAt != 0) {
+    SEMAPHORE_TAKE();
+    AsyncMqttClientInternals::ServerEndpoint& server = _servers.current();
+    server.measure(&server.pingTime, millis() - _pingSentAt);
+    SEMAPHORE_GIVE();
+    _pingSentAt = 0;
+  }
   _lastPingRequestTime = 0;
 }
 
@@ -503,34 +1593,170 @@ void AsyncMqttClient::_onConnAck(bool sessionPresent, uint8_t connectReturnCode)
   log_i("CONNACK");
   _freeCurrentParsedPacket();
 
-  if (!sessionPresent) {
+  if (!sessionPresent && connectReturnCode == 0) {
     _pendingPubRels.clear();
-    _pendingPubRels.shrink_to_fit();
-    _clearQueue(false);  // remove session data
+    // what was pipelined behind CONNECT went to the new session, and a packet may be half sent: keep the queue
+    if (!_pipelineConnect) _clearQueue(false);  // remove session data
+    if (_sessionStore) {
+      SEMAPHORE_TAKE();
+      _compactSession(true);
+      SEMAPHORE_GIVE();
+    }
   }
 
   if (connectReturnCode == 0) {
+    _connectedSince = millis();
+    if (_offline) {
+      _offline = false;
+      _stats.offlineTime += _connectedSince - _offlineSince;
+    }
+    SEMAPHORE_TAKE();
+    _topicAliases.reset(_serverTopicAliasMaximum);
+    AsyncMqttClientInternals::ServerEndpoint& server = _servers.current();
+    server.measure(&server.connAckTime, _connectedSince - _connectStartedAt);
+    server.failures = 0;
+    SEMAPHORE_GIVE();
+    _connectStartedAt = 0;
     _state = CONNECTED;
-    for (auto callback : _onConnectUserCallbacks) callback(sessionPresent);
+    _awaitingConnAck = false;
+    if (_subscriptionReplay) _replaySubscriptions(sessionPresent);
+    for (const auto& callback : _onConnectUserCallbacks) callback(sessionPresent);
   } else {
     // Callbacks are handled by the onDisconnect function which is called from the AsyncTcp lib
-    _disconnectReason = static_cast<AsyncMqttClientDisconnectReason>(connectReturnCode);
+    if (_protocolLevel != AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0) {
+      _disconnectReason = static_cast<AsyncMqttClientDisconnectReason>(connectReturnCode);
+    } else {
+      // MQTT 5.0 reason codes, mapped to the closest MQTT 3.1.1 return code
+      switch (connectReturnCode) {
+        case 0x84:
+          _disconnectReason = AsyncMqttClientDisconnectReason::MQTT_UNACCEPTABLE_PROTOCOL_VERSION;
+          break;
+        case 0x85:
+          _disconnectReason = AsyncMqttClientDisconnectReason::MQTT_IDENTIFIER_REJECTED;
+          break;
+        case 0x86:
+          _disconnectReason = AsyncMqttClientDisconnectReason::MQTT_MALFORMED_CREDENTIALS;
+          break;
+        case 0x87:
+        case 0x8C:
+          _disconnectReason = AsyncMqttClientDisconnectReason::MQTT_NOT_AUTHORIZED;
+          break;
+        default:
+          _disconnectReason = AsyncMqttClientDisconnectReason::MQTT_SERVER_UNAVAILABLE;
+      }
+    }
     return;
   }
   _handleQueue();  // send any remaining data from continued session
 }
 
-void AsyncMqttClient::_onSubAck(uint16_t packetId, char status) {
+void AsyncMqttClient::_prepareProperties(AsyncMqttClientInternals::OutPacket* packet) {
+  // An MQTT 5.0 QoS 0 PUBLISH is given its topic alias right before it is sent:
+  // aliases only hold for the connection, and the server learns them in order.
+  if (_protocolLevel != AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0 ||
+      packet->packetType() != AsyncMqttClientInternals::PacketType.PUBLISH) return;
+  AsyncMqttClientInternals::PublishOutPacket* publish = static_cast<AsyncMqttClientInternals::PublishOutPacket*>(packet);
+  if (publish->hasProperties()) return;
+  size_t size = publish->size();
+  publish->setProperties();
+  // no alias for a packet the server does not take, it would not learn the topic
+  if (_serverMaximumPacketSize == 0 || publish->size() + 3 <= _serverMaximumPacketSize) {
+    size_t topicLength;
+    const char* topic = publish->topic(&topicLength);
+    bool known = false;
+    uint16_t alias = _topicAliases.alias(topic, topicLength, &known);
+    if (alias != 0) publish->setProperties(alias, !known);
+  }
+  _queuedBytes = _queuedBytes - size + publish->size();
+}
+
+void AsyncMqttClient::_onConnAckProperty(uint8_t id, uint32_t value) {
+  SEMAPHORE_TAKE();
+  switch (id) {
+    case AsyncMqttClientInternals::Property.RECEIVE_MAXIMUM:
+      if (value > 0) _serverReceiveMaximum = value;
+      break;
+    case AsyncMqttClientInternals::Property.MAXIMUM_PACKET_SIZE:
+      _serverMaximumPacketSize = value;
+      break;
+    case AsyncMqttClientInternals::Property.TOPIC_ALIAS_MAXIMUM:
+      _serverTopicAliasMaximum = value;
+      break;
+  }
+  SEMAPHORE_GIVE();
+}
+
+void AsyncMqttClient::_replaySubscriptions(bool sessionPresent) {
+  // A new session lost every subscription. A kept session lost the ones still
+  // queued or waiting for their SUBACK, they were dropped with the connection.
+  // skip the filters of SUBSCRIBE packets still queued or pipelined behind CONNECT
+  std::vector<AsyncMqttClientInternals::TopicRoute*> queued;
+  std::string queuedFilter;
+  auto collect = [&](const AsyncMqttClientInternals::OutPacket* packet) {
+    if (packet->packetType() != AsyncMqttClientInternals::PacketType.SUBSCRIBE) return;
+    reinterpret_cast<const AsyncMqttClientInternals::SubscribeOutPacket*>(packet)->forEachFilter([&](const char* topic, size_t topicLength, uint8_t) {
+      queuedFilter.assign(topic, topicLength);
+      AsyncMqttClientInternals::TopicRoute* route = _topicRoutes.find(queuedFilter.c_str());
+      if (route) queued.push_back(route);
+    });
+  };
+  SEMAPHORE_TAKE();
+  for (const AsyncMqttClientInternals::OutPacket* packet : _pendingSubAcks) collect(packet);
+  for (const AsyncMqttClientInternals::OutPacket* packet = _lanes[QOS_LANE].head; packet; packet = packet->next) collect(packet);
+  SEMAPHORE_GIVE();
+
+  std::vector<std::string> filters;
+  std::vector<uint8_t> qos;
+  _topicRoutes.forEach([&](const std::string& filter, AsyncMqttClientInternals::TopicRoute& route) {
+    if (route.subscription == AsyncMqttClientInternals::TopicRoute::UNSUBSCRIBED) return;
+    if (std::find(queued.begin(), queued.end(), &route) != queued.end()) return;
+    if (sessionPresent && route.subscription == AsyncMqttClientInternals::TopicRoute::SUBSCRIBED) return;
+    route.subscription = AsyncMqttClientInternals::TopicRoute::PENDING;
+    filters.push_back(filter);
+    qos.push_back(route.qos);
+  });
+
+  AsyncMqttClientSubscription batch[MQTT_SUBSCRIBE_BATCH_MAX];
+  for (size_t first = 0; first < filters.size(); first += MQTT_SUBSCRIBE_BATCH_MAX) {
+    size_t count = filters.size() - first;
+    if (count > MQTT_SUBSCRIBE_BATCH_MAX) count = MQTT_SUBSCRIBE_BATCH_MAX;
+    for (size_t i = 0; i < count; i++) batch[i] = {filters[first + i].c_str(), qos[first + i]};
+    uint16_t packetId = _allocatePacketId();
+    if (packetId == 0) return;  // the rest stays pending until the next connection
+    log_i("SUBSCRIBE replay (%u)", count);
+    _addBack(new AsyncMqttClientInternals::SubscribeOutPacket(batch, count, packetId, _protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0));
+  }
+}
+
+void AsyncMqttClient::_onSubAck(uint16_t packetId, const uint8_t* returnCodes, size_t count) {
   log_i("SUBACK");
   _freeCurrentParsedPacket();
   SEMAPHORE_TAKE();
-  if (_head && _head->packetId() == packetId) {
-    _head->release();
+  AsyncMqttClientInternals::OutPacket* packet = _takePendingSubAck(AsyncMqttClientInternals::PacketType.SUBSCRIBE, packetId);
+  if (packet) {
+    _packetIds.release(packetId);
     log_i("SUB released");
   }
   SEMAPHORE_GIVE();
+  if (packet && _subscriptionReplay) {
+    size_t index = 0;
+    std::string filter;
+    reinterpret_cast<AsyncMqttClientInternals::SubscribeOutPacket*>(packet)->forEachFilter([&](const char* topic, size_t topicLength, uint8_t) {
+      filter.assign(topic, topicLength);
+      AsyncMqttClientInternals::TopicRoute* route = _topicRoutes.find(filter.c_str());
+      if (route && route->subscription == AsyncMqttClientInternals::TopicRoute::PENDING) {
+        bool failed = index >= count || (returnCodes[index] & 0x80);  // a filter without return code failed
+        route->subscription = failed ? AsyncMqttClientInternals::TopicRoute::UNSUBSCRIBED : AsyncMqttClientInternals::TopicRoute::SUBSCRIBED;
+        if (!failed) route->qos = returnCodes[index];
+      }
+      index++;
+    });
+  }
+  delete packet;
 
-  for (auto callback : _onSubscribeUserCallbacks) callback(packetId, status);
+  uint8_t returnCode = (count > 0) ? returnCodes[0] : 0x80;  // a SUBACK without return codes is a failure
+  for (const auto& callback : _onSubscribeUserCallbacks) callback(packetId, returnCode);
+  for (const auto& callback : _onSubscribeResultsUserCallbacks) callback(packetId, returnCodes, count);
 
   _handleQueue();  // subscribe confirmed, ready to send next queued item
 }
@@ -539,27 +1765,29 @@ void AsyncMqttClient::_onUnsubAck(uint16_t packetId) {
   log_i("UNSUBACK");
   _freeCurrentParsedPacket();
   SEMAPHORE_TAKE();
-  if (_head && _head->packetId() == packetId) {
-    _head->release();
+  AsyncMqttClientInternals::OutPacket* packet = _takePendingSubAck(AsyncMqttClientInternals::PacketType.UNSUBSCRIBE, packetId);
+  if (packet) {
+    _packetIds.release(packetId);
     log_i("UNSUB released");
   }
   SEMAPHORE_GIVE();
+  delete packet;
 
-  for (auto callback : _onUnsubscribeUserCallbacks) callback(packetId);
+  for (const auto& callback : _onUnsubscribeUserCallbacks) callback(packetId);
 
   _handleQueue();  // unsubscribe confirmed, ready to send next queued item
 }
 
 void AsyncMqttClient::_onMessage(char* topic, char* payload, uint8_t qos, bool dup, bool retain, size_t len, size_t index, size_t total, uint16_t packetId) {
-  bool notifyPublish = true;
-
-  if (qos == 2) {
-    for (AsyncMqttClientInternals::PendingPubRel pendingPubRel : _pendingPubRels) {
-      if (pendingPubRel.packetId == packetId) {
-        notifyPublish = false;
-        break;
-      }
-    }
+  bool notifyPublish = !(qos == 2 && _pendingPubRels.contains(packetId));  // a duplicate awaiting its PUBREL
+
+  if (notifyPublish && _reassemblyBuffer && len < total && total <= _reassemblySize) {
+    // a message split over TCP segments is collected and handed over whole
+    memcpy(_reassemblyBuffer + index, payload, len);
+    if (index + len < total) return;
+    payload = _reassemblyBuffer;
+    len = total;
+    index = 0;
   }
 
   if (notifyPublish) {
@@ -568,7 +1796,15 @@ void AsyncMqttClient::_onMessage(char* topic, char* payload, uint8_t qos, bool d
     properties.dup = dup;
     properties.retain = retain;
 
-    for (auto callback : _onMessageUserCallbacks) callback(topic, payload, properties, len, index, total);
+    // the filters are matched on the first chunk, a handler may change the topic buffer
+    if (index == 0) {
+      _messageRoutes.clear();
+      _topicRoutes.match(topic, [this](AsyncMqttClientInternals::TopicRoute& route) { _messageRoutes.push_back(&route); });
+    }
+    for (const auto& callback : _onMessageUserCallbacks) callback(topic, payload, properties, len, index, total);
+    for (AsyncMqttClientInternals::TopicRoute* route : _messageRoutes) {
+      for (const auto& callback : route->handlers) callback(topic, payload, properties, len, index, total);
+    }
   }
 }
 
@@ -588,18 +1824,14 @@ void AsyncMqttClient::_onPublish(uint16_t packetId, uint8_t qos) {
     AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::PubAckOutPacket(pendingAck);
     _addBack(msg);
 
-    bool pubRelAwaiting = false;
-    for (AsyncMqttClientInternals::PendingPubRel pendingPubRel : _pendingPubRels) {
-      if (pendingPubRel.packetId == packetId) {
-        pubRelAwaiting = true;
-        break;
+    if (!_pendingPubRels.contains(packetId)) {
+      SEMAPHORE_TAKE();
+      if (_pendingPubRels.insert(packetId)) {
+        if (_sessionStore) _journal(AsyncMqttClientInternals::SessionRecord.PUBREC, packetId);
+      } else {
+        log_w("too many QoS 2 messages awaiting PUBREL, %u is not deduplicated", packetId);
       }
-    }
-
-    if (!pubRelAwaiting) {
-      AsyncMqttClientInternals::PendingPubRel pendingPubRel;
-      pendingPubRel.packetId = packetId;
-      _pendingPubRels.push_back(pendingPubRel);
+      SEMAPHORE_GIVE();
     }
   }
 
@@ -613,37 +1845,67 @@ void AsyncMqttClient::_onPubRel(uint16_t packetId) {
   pendingAck.packetType = AsyncMqttClientInternals::PacketType.PUBCOMP;
   pendingAck.headerFlag = AsyncMqttClientInternals::HeaderFlag.PUBCOMP_RESERVED;
   pendingAck.packetId = packetId;
-  if (_head && _head->packetId() == packetId) {
-    AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::PubAckOutPacket(pendingAck);
-    _head->release();
-    _insert(msg);
-    log_i("PUBREC released");
-  }
+  AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::PubAckOutPacket(pendingAck);
+  _addBack(msg);
+  log_i("snd PUBCOMP");
 
-  for (size_t i = 0; i < _pendingPubRels.size(); i++) {
-    if (_pendingPubRels[i].packetId == packetId) {
-      _pendingPubRels.erase(_pendingPubRels.begin() + i);
-      _pendingPubRels.shrink_to_fit();
-    }
+  SEMAPHORE_TAKE();
+  if (_pendingPubRels.erase(packetId) && _sessionStore) {
+    _journal(AsyncMqttClientInternals::SessionRecord.RELEASED, packetId);
   }
+  if (_sessionStore) _compactSession(false);
+  SEMAPHORE_GIVE();
 }
 
 void AsyncMqttClient::_onPubAck(uint16_t packetId) {
   _freeCurrentParsedPacket();
-  if (_head && _head->packetId() == packetId) {
-    _head->release();
+  SEMAPHORE_TAKE();
+  AsyncMqttClientInternals::OutPacket* packet = _findInflight(AsyncMqttClientInternals::PacketType.PUBLISH, packetId);
+  if (packet) {
+    if (!_takeInflight(packet)) packet = nullptr;  // deleted once TCP is done with it
+    _packetIds.release(packetId);
     log_i("PUB released");
+    if (_sessionStore) {
+      _journal(AsyncMqttClientInternals::SessionRecord.COMPLETED, packetId);
+      _compactSession(false);
+    }
   }
+  SEMAPHORE_GIVE();
+  delete packet;
 
-  for (auto callback : _onPublishUserCallbacks) callback(packetId);
+  for (const auto& callback : _onPublishUserCallbacks) callback(packetId);
+
+  _handleQueue();  // a slot in the in-flight window is free again
 }
 
-void AsyncMqttClient::_onPubRec(uint16_t packetId) {
+void AsyncMqttClient::_onPubRec(uint16_t packetId, uint8_t reasonCode) {
   _freeCurrentParsedPacket();
 
-  // We will only be sending 1 QoS>0 PUB message at a time (to honor message
-  // ordering). So no need to store ACKS in a separate container as it will
-  // be stored in the outgoing queue until a PUBCOMP comes in.
+  if (reasonCode >= 0x80) {
+    // MQTT 5.0: the server refused the message, the flow ends without PUBREL
+    log_w("PUBREC %u refused (%u)", packetId, reasonCode);
+    SEMAPHORE_TAKE();
+    AsyncMqttClientInternals::OutPacket* packet = _findInflight(AsyncMqttClientInternals::PacketType.PUBLISH, packetId);
+    bool refused = packet != nullptr;
+    if (packet) {
+      if (!_takeInflight(packet)) packet = nullptr;  // deleted once TCP is done with it
+      _packetIds.release(packetId);
+      if (_sessionStore) {
+        _journal(AsyncMqttClientInternals::SessionRecord.COMPLETED, packetId);
+        _compactSession(false);
+      }
+    }
+    SEMAPHORE_GIVE();
+    delete packet;
+    if (refused) {
+      for (const auto& callback : _onErrorUserCallbacks) callback(packetId, AsyncMqttClientError::PUBLISH_REFUSED);
+    }
+    _handleQueue();  // a slot in the in-flight window is free again
+    return;
+  }
+
+  // The PUBREL takes over the in-flight slot of the PUBLISH right away, while
+  // it is also queued to be sent. It stays in flight until PUBCOMP comes in.
   AsyncMqttClientInternals::PendingAck pendingAck;
   pendingAck.packetType = AsyncMqttClientInternals::PacketType.PUBREL;
   pendingAck.headerFlag = AsyncMqttClientInternals::HeaderFlag.PUBREL_RESERVED;
@@ -651,28 +1913,59 @@ void AsyncMqttClient::_onPubRec(uint16_t packetId) {
   log_i("snd PUBREL");
 
   AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::PubAckOutPacket(pendingAck);
-  if (_head && _head->packetId() == packetId) {
-    _head->release();
+  SEMAPHORE_TAKE();
+  AsyncMqttClientInternals::OutPacket* packet = _findInflight(AsyncMqttClientInternals::PacketType.PUBLISH, packetId);
+  if (packet) {
+    *std::find(_inflight.begin(), _inflight.end(), packet) = msg;
+    if (!_forget(packet)) packet = nullptr;  // deleted once TCP is done with it
     log_i("PUB released");
+    if (_sessionStore) _journal(AsyncMqttClientInternals::SessionRecord.PUBREL, packetId);
+  } else {
+    msg->release();  // nothing in flight to complete, do not hold a slot for it
   }
-  _insert(msg);
+  SEMAPHORE_GIVE();
+  _addBack(msg);
+  delete packet;
 }
 
 void AsyncMqttClient::_onPubComp(uint16_t packetId) {
   _freeCurrentParsedPacket();
 
-  // _head points to the PUBREL package
-  if (_head && _head->packetId() == packetId) {
-    _head->release();
+  SEMAPHORE_TAKE();
+  AsyncMqttClientInternals::OutPacket* packet = _findInflight(AsyncMqttClientInternals::PacketType.PUBREL, packetId);
+  if (packet) {
+    if (!_takeInflight(packet)) packet = nullptr;  // deleted once TCP is done with it
+    _packetIds.release(packetId);
     log_i("PUBREL released");
+    if (_sessionStore) {
+      _journal(AsyncMqttClientInternals::SessionRecord.COMPLETED, packetId);
+      _compactSession(false);
+    }
   }
+  SEMAPHORE_GIVE();
+  delete packet;
+
+  for (const auto& callback : _onPublishUserCallbacks) callback(packetId);
 
-  for (auto callback : _onPublishUserCallbacks) callback(packetId);
+  _handleQueue();  // a slot in the in-flight window is free again
+}
+
+void AsyncMqttClient::_onDisconnectPacket(uint8_t reasonCode) {
+  log_i("DISCONNECT by server (0x%02x)", reasonCode);
+  _freeCurrentParsedPacket();
+  // a server shutting down or taken over: the reconnect engine tries again
+  _closeConnection(AsyncMqttClientDisconnectReason::MQTT_SERVER_DISCONNECTED);
+}
+
+void AsyncMqttClient::_closeConnection(AsyncMqttClientDisconnectReason reason) {
+  _disconnectReason = reason;
+  _client.close(true);
 }
 
 void AsyncMqttClient::_sendPing() {
   log_i("PING");
   _lastPingRequestTime = millis();
+  _pingSentAt = _lastPingRequestTime;
   AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::PingReqOutPacket;
   _addBack(msg);
 }
@@ -682,22 +1975,54 @@ bool AsyncMqttClient::connected() const {
 }
 
 void AsyncMqttClient::connect() {
-  if (_state != DISCONNECTED) return;
+  _reconnectWanted = true;
+  _cancelReconnect();
+  if (_state != DISCONNECTED || _servers.size() == 0) return;
+  SEMAPHORE_TAKE();
+  _servers.select();
+  SEMAPHORE_GIVE();
+  _pickServer();
   log_i("CONNECTING");
   _state = CONNECTING;
+  _awaitingConnAck = true;
   _disconnectReason = AsyncMqttClientDisconnectReason::TCP_DISCONNECTED;  // reset any previous
 
   _client.setRxTimeout(_keepAlive);
 
+  // Connect to a cached address of the host rather than wait for a lookup, a
+  // stale one is refreshed meanwhile. With none left to try, the TCP library
+  // looks the host up, and the address it connected to is cached.
+  _connectStartedAt = millis();
+  IPAddress ip = _ip;
+  bool useIp = _useIp;
+  if (!_useIp) {
+    SEMAPHORE_TAKE();
+    _takeResolved();
+    if (_servers.current().dns.get(_dnsAttempt, &ip)) {
+      useIp = true;
+      _dnsIndex = _dnsAttempt;
+    } else {
+      _dnsAttempt = 0;
+    }
+    SEMAPHORE_GIVE();
+    if (useIp) _resolve();
+  }
+
 #if ASYNC_TCP_SSL_ENABLED
-  if (_useIp) {
-    _client.connect(_ip, _port, _secure);
+  if (_secure) {
+    SEMAPHORE_TAKE();
+    AsyncMqttClientTlsSession session = _servers.current().tlsSession;
+    SEMAPHORE_GIVE();
+    _tls->offerSession(&_client, session.id, session.length);  // none if the length is 0
+  }
+  if (useIp) {
+    _client.connect(ip, _port, _secure);
   } else {
     _client.connect(_host, _port, _secure);
   }
 #else
-  if (_useIp) {
-    _client.connect(_ip, _port);
+  if (useIp) {
+    _client.connect(ip, _port);
   } else {
     _client.connect(_host, _port);
   }
@@ -705,6 +2030,9 @@ void AsyncMqttClient::connect() {
 }
 
 void AsyncMqttClient::disconnect(bool force) {
+  _reconnectWanted = false;
+  _offline = false;
+  _cancelReconnect();
   if (_state == DISCONNECTED) return;
   log_i("DISCONNECT (f:%d)", force);
   if (force) {
@@ -718,38 +2046,288 @@ void AsyncMqttClient::disconnect(bool force) {
 }
 
 uint16_t AsyncMqttClient::subscribe(const char* topic, uint8_t qos) {
-  if (_state != CONNECTED) return 0;
+  AsyncMqttClientSubscription subscription = {topic, qos};
+  return subscribe(&subscription, 1);
+}
+
+uint16_t AsyncMqttClient::subscribe(const AsyncMqttClientSubscription* subscriptions, size_t count) {
+  if (!_canQueue() || count == 0 || count > MQTT_SUBSCRIBE_BATCH_MAX) return 0;
+  uint16_t packetId = _allocatePacketId();
+  if (packetId == 0) return 0;
   log_i("SUBSCRIBE");
 
-  AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::SubscribeOutPacket(topic, qos);
+  AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::SubscribeOutPacket(subscriptions, count, packetId, _protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0);
   _addBack(msg);
-  return msg->packetId();
+  if (_subscriptionReplay) {
+    for (size_t i = 0; i < count; i++) {
+      AsyncMqttClientInternals::TopicRoute& route = _topicRoutes.insert(subscriptions[i].topic);
+      route.subscription = AsyncMqttClientInternals::TopicRoute::PENDING;
+      route.qos = subscriptions[i].qos;
+    }
+  }
+  return packetId;
 }
 
 uint16_t AsyncMqttClient::unsubscribe(const char* topic) {
-  if (_state != CONNECTED) return 0;
+  return unsubscribe(&topic, 1);
+}
+
+uint16_t AsyncMqttClient::unsubscribe(const char* const* topics, size_t count) {
+  if (!_canQueue() || count == 0 || count > MQTT_SUBSCRIBE_BATCH_MAX) return 0;
+  uint16_t packetId = _allocatePacketId();
+  if (packetId == 0) return 0;
   log_i("UNSUBSCRIBE");
 
-  AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::UnsubscribeOutPacket(topic);
+  AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::UnsubscribeOutPacket(topics, count, packetId, _protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0);
   _addBack(msg);
-  return msg->packetId();
+  if (_subscriptionReplay) {
+    for (size_t i = 0; i < count; i++) {
+      AsyncMqttClientInternals::TopicRoute* route = _topicRoutes.find(topics[i]);
+      if (route) route->subscription = AsyncMqttClientInternals::TopicRoute::UNSUBSCRIBED;
+    }
+  }
+  return packetId;
 }
 
 uint16_t AsyncMqttClient::publish(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length, bool dup, uint16_t message_id) {
-  if (_state != CONNECTED || GET_FREE_MEMORY() < MQTT_MIN_FREE_MEMORY) return 0;
+  if (!_canQueue()) return 0;
+  // upper bound of the packet size: fixed header, topic, packet ID and payload
+  size_t payloadLength = (payload != nullptr && length == 0) ? strlen(payload) : length;
+  if (!_admit(5 + 2 + strlen(topic) + 2 + payloadLength)) return 0;
+  uint16_t packetId = 1;  // what QoS 0 messages always reported
+  if (qos > 0 && (packetId = _allocatePacketId()) == 0) return 0;
   log_i("PUBLISH");
 
-  AsyncMqttClientInternals::OutPacket* msg = new AsyncMqttClientInternals::PublishOutPacket(topic, qos, retain, payload, length);
+  AsyncMqttClientInternals::PublishOutPacket* msg = new AsyncMqttClientInternals::PublishOutPacket(topic, qos, retain, payload, length, packetId);
+  if (_protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0 && qos > 0) msg->setProperties();  // QoS 0 is given its properties when sent, see _handleQueue()
   _addBack(msg);
-  return msg->packetId();
+  return packetId;
+}
+
+uint16_t AsyncMqttClient::publishNoCopy(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length, AsyncMqttClientInternals::OnPayloadReleaseUserCallback onRelease) {
+  if (!_canQueue()) return 0;
+  if (!_admit(5 + 2 + strlen(topic) + 2 + length)) return 0;
+  uint16_t packetId = 1;
+  if (qos > 0 && (packetId = _allocatePacketId()) == 0) return 0;
+  log_i("PUBLISH (no copy)");
+
+  AsyncMqttClientInternals::PublishOutPacket* msg = new AsyncMqttClientInternals::PublishOutPacket(topic, qos, retain, payload, length, onRelease, packetId);
+  if (_protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0 && qos > 0) msg->setProperties();  // QoS 0 is given its properties when sent, see _handleQueue()
+  _addBack(msg);
+  return packetId;
+}
+
+uint16_t AsyncMqttClient::publishStream(const char* topic, uint8_t qos, bool retain, size_t length, AsyncMqttClientInternals::OnPayloadChunkUserCallback producer) {
+  if (!_canQueue()) return 0;
+  if (!_admit(5 + 2 + strlen(topic) + 2 + length)) return 0;  // its full size counts against the queue limits like any message
+  uint16_t packetId = 1;
+  if (qos > 0 && (packetId = _allocatePacketId()) == 0) return 0;
+  log_i("PUBLISH (stream)");
+
+  AsyncMqttClientInternals::PublishOutPacket* msg = new AsyncMqttClientInternals::PublishStreamOutPacket(topic, qos, retain, length, producer, packetId);
+  if (_protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0 && qos > 0) msg->setProperties();  // QoS 0 is given its properties when sent, see _handleQueue()
+  _addBack(msg);
+  return packetId;
 }
 
 bool AsyncMqttClient::clearQueue() {
   if (_state != DISCONNECTED) return false;
   _clearQueue(false);
+  if (_sessionStore) {
+    SEMAPHORE_TAKE();
+    _compactSession(true);
+    SEMAPHORE_GIVE();
+  }
   return true;
 }
 
 const char* AsyncMqttClient::getClientId() const {
   return _clientId;
 }
+
+AsyncMqttClientStats AsyncMqttClient::getStats() const {
+  AsyncMqttClientStats stats = _stats;
+  stats.queuedBytes = _queuedBytes;
+  stats.queuedPackets = _queuedPackets;
+  stats.pendingPubRels = _pendingPubRels.size();
+  stats.pendingPubRelsHighWater = _pendingPubRels.highWater();
+  if (_offline) stats.offlineTime += millis() - _offlineSince;
+  return stats;
+}
+
+AsyncMqttClientServerStats AsyncMqttClient::getServerStats(size_t index) const {
+  AsyncMqttClientServerStats stats = {};
+  if (index >= _servers.size()) return stats;
+  const AsyncMqttClientInternals::ServerEndpoint& server = _servers[index];
+  stats.connectTime = server.connectTime;
+  stats.connAckTime = server.connAckTime;
+  stats.pingTime = server.pingTime;
+  stats.rtt = server.rtt;
+  stats.failures = server.failures;
+  stats.current = index == _servers.currentIndex();
+  return stats;
+}
+
+#if ASYNC_TCP_SSL_ENABLED
+AsyncMqttClientTlsSession AsyncMqttClient::getTlsSession(size_t index) const {
+  AsyncMqttClientTlsSession session = {};
+  if (index < _servers.size()) session = _servers[index].tlsSession;
+  return session;
+}
+#endif
+
+AsyncMqttClientPoolStats AsyncMqttClient::getPoolStats() {
+  AsyncMqttClientPoolStats stats;
+  stats.ackPackets = AsyncMqttClientInternals::PubAckOutPacket::poolUsage();
+  stats.pingPackets = AsyncMqttClientInternals::PingReqOutPacket::poolUsage();
+  stats.disconnPackets = AsyncMqttClientInternals::DisconnOutPacket::poolUsage();
+  stats.publishPackets = AsyncMqttClientInternals::PublishOutPacket::poolUsage();
+  stats.publishBuffers = AsyncMqttClientInternals::PublishBufferAllocator::poolUsage();
+  return stats;
+}
+
+/* SESSION */
+
+bool AsyncMqttClient::_appendSessionRecord(uint8_t record, uint16_t packetId, const AsyncMqttClientInternals::OutPacket* packet) {
+  // handed to the store in place: the header, then the serialized packet and a caller-owned payload
+  uint8_t header[3] = {record, static_cast<uint8_t>(packetId >> 8), static_cast<uint8_t>(packetId & 0xFF)};
+  AsyncMqttClientSessionRecordPart parts[3] = {{header, sizeof(header)}};
+  size_t count = 1;
+  size_t length = sizeof(header);
+  if (packet) {
+    for (size_t index = 0; index < packet->size(); index += packet->available(index)) {
+      if (count == 3) return false;  // not a journaled packet
+      parts[count++] = {packet->data(index), packet->available(index)};
+    }
+    length += packet->size();
+  }
+  if (!_sessionStore->append(parts, count)) return false;
+  _journalSize += length;
+  return true;
+}
+
+void AsyncMqttClient::_journal(uint8_t record, uint16_t packetId, const AsyncMqttClientInternals::OutPacket* packet) {
+  if (!_appendSessionRecord(record, packetId, packet)) {
+    log_w("session journal full");
+    _sessionCompactDue = true;
+  }
+}
+
+void AsyncMqttClient::_compactSession(bool force) {
+  if (!force && !_sessionCompactDue && _journalSize < _sessionCompactSize) return;
+  log_i("compact session");
+  if (!_sessionStore->beginRewrite()) {
+    log_w("session compaction failed");
+    _sessionStore->abortRewrite();
+    _sessionCompactDue = true;  // tried again on the next acknowledgement
+    return;
+  }
+
+  // write the live session in the order it is replayed: in-flight flows, queued messages, then incoming flows
+  size_t previousSize = _journalSize;
+  _journalSize = 0;
+  bool ok = true;
+  for (AsyncMqttClientInternals::OutPacket* packet : _inflight) {
+    if (packet->packetType() == AsyncMqttClientInternals::PacketType.PUBREL) {
+      ok = ok && _appendSessionRecord(AsyncMqttClientInternals::SessionRecord.PUBREL, packet->packetId());
+    } else if (packet->persistent()) {
+      ok = ok && _appendSessionRecord(AsyncMqttClientInternals::SessionRecord.PUBLISH, packet->packetId(), packet);
+    }
+  }
+  for (AsyncMqttClientInternals::OutPacket* packet = _lanes[QOS_LANE].head; packet; packet = packet->next) {
+    if (packet->persistent() && std::find(_inflight.begin(), _inflight.end(), packet) == _inflight.end()) {
+      ok = ok && _appendSessionRecord(AsyncMqttClientInternals::SessionRecord.PUBLISH, packet->packetId(), packet);
+    }
+  }
+  _pendingPubRels.forEach([this, &ok](uint16_t packetId) {
+    ok = ok && _appendSessionRecord(AsyncMqttClientInternals::SessionRecord.PUBREC, packetId);
+  });
+
+  if (ok && _sessionStore->commitRewrite()) {
+    _sessionCompactDue = false;
+  } else {
+    log_w("session compaction failed");
+    _sessionStore->abortRewrite();
+    _journalSize = previousSize;  // the old journal is still in use
+    _sessionCompactDue = true;    // tried again on the next acknowledgement
+  }
+}
+
+void AsyncMqttClient::_restoreSession() {
+  struct Entry {
+    uint8_t record;
+    uint16_t packetId;
+    std::vector<uint8_t> packet;
+  };
+  std::vector<Entry> entries;
+  std::vector<uint16_t> dropped;  // reported once unlocked
+  auto find = [&entries](uint16_t packetId, bool incoming) {
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (it->packetId == packetId && (it->record == AsyncMqttClientInternals::SessionRecord.PUBREC) == incoming) return it;
+    }
+    return entries.end();
+  };
+
+  // fold the journal into the live session
+  _sessionStore->replay([&](const uint8_t* data, size_t length) {
+    if (length < 3) return;
+    uint8_t record = data[0];
+    uint16_t packetId = data[1] << 8 | data[2];
+    if (record == AsyncMqttClientInternals::SessionRecord.PUBLISH) {
+      if (!AsyncMqttClientInternals::PublishOutPacket::valid(data + 3, length - 3, _protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0)) {
+        log_w("corrupt session record for %u dropped", packetId);
+        dropped.push_back(packetId);
+        return;
+      }
+      entries.push_back(Entry{record, packetId, std::vector<uint8_t>(data + 3, data + length)});
+    } else if (record == AsyncMqttClientInternals::SessionRecord.PUBREL) {
+      auto it = find(packetId, false);
+      if (it == entries.end()) {
+        entries.push_back(Entry{record, packetId, std::vector<uint8_t>()});
+      } else {
+        it->record = record;
+        it->packet.clear();
+      }
+    } else if (record == AsyncMqttClientInternals::SessionRecord.COMPLETED) {
+      auto it = find(packetId, false);
+      if (it != entries.end()) entries.erase(it);
+    } else if (record == AsyncMqttClientInternals::SessionRecord.PUBREC) {
+      if (find(packetId, true) == entries.end()) entries.push_back(Entry{record, packetId, std::vector<uint8_t>()});
+    } else if (record == AsyncMqttClientInternals::SessionRecord.RELEASED) {
+      auto it = find(packetId, true);
+      if (it != entries.end()) entries.erase(it);
+    }
+  });
+
+  SEMAPHORE_TAKE();
+  for (const Entry& entry : entries) {
+    if (entry.record != AsyncMqttClientInternals::SessionRecord.PUBREC && !_packetIds.reserve(entry.packetId)) {
+      // not tracked by the allocator, it could be handed out twice
+      log_w("restored packet ID %u out of the window, dropped", entry.packetId);
+      dropped.push_back(entry.packetId);
+      continue;
+    }
+    if (entry.record == AsyncMqttClientInternals::SessionRecord.PUBLISH) {
+      AsyncMqttClientInternals::PublishOutPacket* packet = new AsyncMqttClientInternals::PublishOutPacket(entry.packet.data(), entry.packet.size(), _protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0);
+      packet->setDup();  // it may have reached the broker before the reboot
+      _enqueue(packet);
+    } else if (entry.record == AsyncMqttClientInternals::SessionRecord.PUBREL) {
+      AsyncMqttClientInternals::PendingAck pendingAck;
+      pendingAck.packetType = AsyncMqttClientInternals::PacketType.PUBREL;
+      pendingAck.headerFlag = AsyncMqttClientInternals::HeaderFlag.PUBREL_RESERVED;
+      pendingAck.packetId = entry.packetId;
+      AsyncMqttClientInternals::OutPacket* packet = new AsyncMqttClientInternals::PubAckOutPacket(pendingAck);
+      _inflight.push_back(packet);  // holds its slot until PUBCOMP, like after a PUBREC
+      _enqueue(packet);
+    } else if (!_pendingPubRels.insert(entry.packetId)) {
+      log_w("too many QoS 2 messages awaiting PUBREL, %u is not deduplicated", entry.packetId);
+    }
+  }
+  log_i("session restored (%u)", entries.size());
+  _compactSession(true);  // drops acknowledged flows, a torn last record and the dropped flows
+  SEMAPHORE_GIVE();
+
+  for (uint16_t packetId : dropped) {
+    for (const auto& callback : _onErrorUserCallbacks) callback(packetId, AsyncMqttClientError::SESSION_RECORD_DROPPED);
+  }
+}
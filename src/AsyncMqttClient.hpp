@@ -9,11 +9,40 @@
 #define MQTT_MIN_FREE_MEMORY 4096
 #endif
 
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 1
+#endif
+
+// retransmission timer wheel: resolution in ms and number of slots
+#ifndef MQTT_RETRANSMIT_TICK
+#define MQTT_RETRANSMIT_TICK 100
+#endif
+
+#ifndef MQTT_RETRANSMIT_SLOTS
+#define MQTT_RETRANSMIT_SLOTS 64
+#endif
+
+// journal size from which it is compacted on the next ack
+#ifndef MQTT_SESSION_COMPACT_SIZE
+#define MQTT_SESSION_COMPACT_SIZE 4096
+#endif
+
+// 0 means unlimited
+#ifndef MQTT_MAX_QUEUE_BYTES
+#define MQTT_MAX_QUEUE_BYTES 0
+#endif
+
+#ifndef MQTT_MAX_QUEUE_PACKETS
+#define MQTT_MAX_QUEUE_PACKETS 0
+#endif
+
 #ifdef ESP32
 #include <AsyncTCP.h>
 #include <freertos/semphr.h>
+#include <freertos/timers.h>
 #elif defined(ESP8266)
 #include <ESPAsyncTCP.h>
+#include <Ticker.h>
 #else
 #error Platform not supported
 #endif
@@ -26,21 +55,26 @@
 #include "AsyncMqttClient/Flags.hpp"
 #include "AsyncMqttClient/ParsingInformation.hpp"
 #include "AsyncMqttClient/MessageProperties.hpp"
+#include "AsyncMqttClient/Subscription.hpp"
+#include "AsyncMqttClient/Stats.hpp"
 #include "AsyncMqttClient/Helpers.hpp"
 #include "AsyncMqttClient/Callbacks.hpp"
 #include "AsyncMqttClient/DisconnectReasons.hpp"
 #include "AsyncMqttClient/Storage.hpp"
+#include "AsyncMqttClient/PacketIds.hpp"
+#include "AsyncMqttClient/PacketIdSet.hpp"
+#include "AsyncMqttClient/TopicTrie.hpp"
+#include "AsyncMqttClient/TopicAliases.hpp"
+#include "AsyncMqttClient/Properties.hpp"
+#include "AsyncMqttClient/DnsCache.hpp"
+#include "AsyncMqttClient/ServerList.hpp"
+#include "AsyncMqttClient/TlsSession.hpp"
+#include "AsyncMqttClient/SessionStore.hpp"
+#include "AsyncMqttClient/FileSessionStore.hpp"
+#include "AsyncMqttClient/FlashSessionStore.hpp"
 
 #include "AsyncMqttClient/Packets/Packet.hpp"
-#include "AsyncMqttClient/Packets/ConnAckPacket.hpp"
-#include "AsyncMqttClient/Packets/PingRespPacket.hpp"
-#include "AsyncMqttClient/Packets/SubAckPacket.hpp"
-#include "AsyncMqttClient/Packets/UnsubAckPacket.hpp"
-#include "AsyncMqttClient/Packets/PublishPacket.hpp"
-#include "AsyncMqttClient/Packets/PubRelPacket.hpp"
-#include "AsyncMqttClient/Packets/PubAckPacket.hpp"
-#include "AsyncMqttClient/Packets/PubRecPacket.hpp"
-#include "AsyncMqttClient/Packets/PubCompPacket.hpp"
+#include "AsyncMqttClient/Packets/Parsers.hpp"
 
 #include "AsyncMqttClient/Packets/Out/Connect.hpp"
 #include "AsyncMqttClient/Packets/Out/PingReq.hpp"
@@ -49,6 +83,7 @@
 #include "AsyncMqttClient/Packets/Out/Subscribe.hpp"
 #include "AsyncMqttClient/Packets/Out/Unsubscribe.hpp"
 #include "AsyncMqttClient/Packets/Out/Publish.hpp"
+#include "AsyncMqttClient/Packets/Out/PublishStream.hpp"
 
 class AsyncMqttClient {
  public:
@@ -58,38 +93,113 @@ class AsyncMqttClient {
   AsyncMqttClient& setKeepAlive(uint16_t keepAlive);
   AsyncMqttClient& setClientId(const char* clientId);
   AsyncMqttClient& setCleanSession(bool cleanSession);
+  AsyncMqttClient& setSessionExpiryInterval(uint32_t seconds);
+  AsyncMqttClient& setProtocolVersion(uint8_t version);
+  AsyncMqttClient& setSubscriptionReplay(bool replay);
+  AsyncMqttClient& setPipelinedConnect(bool pipelined);
+  AsyncMqttClient& setAutoReconnect(uint32_t minDelay, uint32_t maxDelay = 60000, uint32_t stablePeriod = 60000);
   AsyncMqttClient& setMaxTopicLength(uint16_t maxTopicLength);
+  AsyncMqttClient& setMaxPacketSize(uint32_t maxSize);
+  AsyncMqttClient& setMessageReassembly(size_t maxSize);
+  AsyncMqttClient& setMaxInflight(uint16_t maxInflight);
+  AsyncMqttClient& setMaxPendingSubscriptions(uint8_t maxPending);
+  AsyncMqttClient& setWriteCoalescing(size_t threshold, uint32_t flushDeadline);
+  AsyncMqttClient& setQueueLimits(size_t maxBytes, uint16_t maxPackets = 0);
+  AsyncMqttClient& setRetransmission(uint32_t timeout, uint8_t maxRetries, uint32_t maxTimeout = 0);
+  AsyncMqttClient& setSessionStore(AsyncMqttClientSessionStore* store, size_t compactSize = MQTT_SESSION_COMPACT_SIZE);
   AsyncMqttClient& setCredentials(const char* username, const char* password = nullptr);
   AsyncMqttClient& setWill(const char* topic, uint8_t qos, bool retain, const char* payload = nullptr, size_t length = 0);
   AsyncMqttClient& setServer(IPAddress ip, uint16_t port);
   AsyncMqttClient& setServer(const char* host, uint16_t port);
+  AsyncMqttClient& addServer(IPAddress ip, uint16_t port);
+  AsyncMqttClient& addServer(const char* host, uint16_t port);
 #if ASYNC_TCP_SSL_ENABLED
   AsyncMqttClient& setSecure(bool secure);
   AsyncMqttClient& addServerFingerprint(const uint8_t* fingerprint);
+  AsyncMqttClient& setTlsSession(size_t index, const AsyncMqttClientTlsSession& session);  // index of the server, as in getServerStats
+  AsyncMqttClient& setTls(AsyncMqttClientTls* tls);  // nullptr for axTLS through the TCP library
 #endif
 
   AsyncMqttClient& onConnect(AsyncMqttClientInternals::OnConnectUserCallback callback);
   AsyncMqttClient& onDisconnect(AsyncMqttClientInternals::OnDisconnectUserCallback callback);
   AsyncMqttClient& onSubscribe(AsyncMqttClientInternals::OnSubscribeUserCallback callback);
+  AsyncMqttClient& onSubscribeResults(AsyncMqttClientInternals::OnSubscribeResultsUserCallback callback);
   AsyncMqttClient& onUnsubscribe(AsyncMqttClientInternals::OnUnsubscribeUserCallback callback);
   AsyncMqttClient& onMessage(AsyncMqttClientInternals::OnMessageUserCallback callback);
+  AsyncMqttClient& onMessage(const char* filter, AsyncMqttClientInternals::OnMessageUserCallback callback);
   AsyncMqttClient& onPublish(AsyncMqttClientInternals::OnPublishUserCallback callback);
+  AsyncMqttClient& onError(AsyncMqttClientInternals::OnErrorUserCallback callback);
+  AsyncMqttClient& onWritable(AsyncMqttClientInternals::OnWritableUserCallback callback);
 
   bool connected() const;
   void connect();
   void disconnect(bool force = false);
   uint16_t subscribe(const char* topic, uint8_t qos);
+  uint16_t subscribe(const AsyncMqttClientSubscription* subscriptions, size_t count);
   uint16_t unsubscribe(const char* topic);
+  uint16_t unsubscribe(const char* const* topics, size_t count);
   uint16_t publish(const char* topic, uint8_t qos, bool retain, const char* payload = nullptr, size_t length = 0, bool dup = false, uint16_t message_id = 0);
+  uint16_t publishNoCopy(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length, AsyncMqttClientInternals::OnPayloadReleaseUserCallback onRelease);
+  uint16_t publishStream(const char* topic, uint8_t qos, bool retain, size_t length, AsyncMqttClientInternals::OnPayloadChunkUserCallback producer);
   bool clearQueue();  // Not MQTT compliant!
 
   const char* getClientId() const;
+  AsyncMqttClientStats getStats() const;
+  AsyncMqttClientServerStats getServerStats(size_t index) const;  // index in the order the servers were set and added
+#if ASYNC_TCP_SSL_ENABLED
+  AsyncMqttClientTlsSession getTlsSession(size_t index) const;
+#endif
+  static AsyncMqttClientPoolStats getPoolStats();
 
  private:
+  // the parsers report straight to the handlers below
+  friend class AsyncMqttClientInternals::ConnAckPacket;
+  friend class AsyncMqttClientInternals::PingRespPacket;
+  friend class AsyncMqttClientInternals::SubAckPacket;
+  friend class AsyncMqttClientInternals::UnsubAckPacket;
+  friend class AsyncMqttClientInternals::PublishPacket;
+  friend class AsyncMqttClientInternals::PubRelPacket;
+  friend class AsyncMqttClientInternals::PubAckPacket;
+  friend class AsyncMqttClientInternals::PubRecPacket;
+  friend class AsyncMqttClientInternals::PubCompPacket;
+  friend class AsyncMqttClientInternals::DisconnectPacket;
+
   AsyncClient _client;
-  AsyncMqttClientInternals::OutPacket* _head;
-  AsyncMqttClientInternals::OutPacket* _tail;
+  enum : uint8_t {
+    CONTROL_LANE,  // CONNECT, acks and PINGREQ
+    QOS0_LANE,     // QoS 0 PUBLISH and DISCONNECT
+    QOS_LANE,      // QoS>0 PUBLISH, SUBSCRIBE and UNSUBSCRIBE
+    LANES
+  };
+  AsyncMqttClientInternals::OutLane _lanes[LANES];
+  uint8_t _sendingLane;  // lane of the packet in progress while _sent > 0
+  uint32_t _nextSequence;
   size_t _sent;
+  bool _awaitingConnAck;  // from connect() until CONNACK accepts the connection
+  std::vector<AsyncMqttClientInternals::OutPacket*> _pendingSubAcks;  // SUBSCRIBE and UNSUBSCRIBE sent, waiting for their ack
+  uint8_t _maxPendingSubAcks;
+  std::vector<AsyncMqttClientInternals::OutPacket*> _inflight;
+  AsyncMqttClientInternals::PacketIds _packetIds;  // of PUBLISH, PUBREL, SUBSCRIBE and UNSUBSCRIBE until their flow completes
+  uint16_t _maxInflight;
+  uint32_t _retransmitTimeout;  // 0 disables retransmission within a connection
+  uint32_t _retransmitMaxTimeout;
+  uint8_t _maxRetries;
+  AsyncMqttClientInternals::OutPacket* _timerWheel[MQTT_RETRANSMIT_SLOTS];
+  uint32_t _timerTick;  // last tick processed
+  std::vector<AsyncMqttClientInternals::PendingTcpAck> _pendingTcpAcks;
+  uint32_t _bytesSent;
+  uint32_t _bytesAcked;
+  size_t _coalesceThreshold;
+  uint32_t _coalesceDeadline;
+  size_t _unflushed;
+  uint32_t _unflushedSince;
+  AsyncMqttClientStats _stats;
+  size_t _maxQueueBytes;
+  uint16_t _maxQueuePackets;
+  size_t _queuedBytes;
+  uint16_t _queuedPackets;
+  bool _writableWanted;  // a publish was refused, notify once the queue drained to the low-water mark
+  bool _packetIdWanted;  // a message got no packet ID, notify once one is free again
   enum {
     CONNECTING,
     CONNECTED,
@@ -100,17 +210,49 @@ class AsyncMqttClient {
   uint32_t _lastClientActivity;
   uint32_t _lastServerActivity;
   uint32_t _lastPingRequestTime;
+  uint32_t _pingSentAt;  // for the round trip, unlike the above not reset by other packets
+  uint32_t _reconnectMinDelay;  // 0 disables reconnecting
+  uint32_t _reconnectMaxDelay;
+  uint32_t _reconnectStablePeriod;
+  uint32_t _reconnectDelay;     // last backoff delay, grows with the failed attempts
+  bool _reconnectWanted;        // connect() called, disconnect() not
+  uint32_t _connectedSince;
+  bool _offline;                // the connection was lost, not ended by disconnect()
+  uint32_t _offlineSince;
+#if defined(ESP32)
+  TimerHandle_t _reconnectTimer;
+  TimerHandle_t _flushTimer;  // pushes coalesced bytes at their deadline
+#elif defined(ESP8266)
+  Ticker _reconnectTimer;
+  Ticker _flushTimer;
+#endif
 
   char _generatedClientId[18 + 1];  // esp8266-abc123 and esp32-abcdef123456
-  IPAddress _ip;
+  AsyncMqttClientInternals::ServerList _servers;
+  IPAddress _ip;      // the server picked from the list for this connection
   const char* _host;
   bool _useIp;
+  int8_t _dnsIndex;     // cached address the connection is attempted to, -1 if the TCP library looks the host up
+  uint8_t _dnsAttempt;  // cached addresses which failed in a row
+  AsyncMqttClientInternals::DnsLookup* _dnsLookup;  // runs in the background, its answer is taken by _takeResolved
 #if ASYNC_TCP_SSL_ENABLED
   bool _secure;
+  AsyncMqttClientAxTls _axTls;
+  AsyncMqttClientTls* _tls;  // owned by the caller, or _axTls
 #endif
   uint16_t _port;
+  uint32_t _connectStartedAt;  // to measure the TCP (and TLS) handshake, 0 once measured
   uint16_t _keepAlive;
   bool _cleanSession;
+  uint32_t _sessionExpiryInterval;  // MQTT 5.0, in seconds, sent when the session is kept
+  uint8_t _protocolLevel;
+  uint32_t _maxPacketSize;  // advertised to the server, 0 for none
+  uint16_t _serverReceiveMaximum;     // from the last CONNACK
+  uint32_t _serverMaximumPacketSize;  // 0 if the server has no limit
+  uint16_t _serverTopicAliasMaximum;
+  AsyncMqttClientInternals::TopicAliases _topicAliases;  // of QoS 0 PUBLISH, for this connection
+  bool _subscriptionReplay;
+  bool _pipelineConnect;
   const char* _clientId;
   const char* _username;
   const char* _password;
@@ -127,16 +269,29 @@ class AsyncMqttClient {
   std::vector<AsyncMqttClientInternals::OnConnectUserCallback> _onConnectUserCallbacks;
   std::vector<AsyncMqttClientInternals::OnDisconnectUserCallback> _onDisconnectUserCallbacks;
   std::vector<AsyncMqttClientInternals::OnSubscribeUserCallback> _onSubscribeUserCallbacks;
+  std::vector<AsyncMqttClientInternals::OnSubscribeResultsUserCallback> _onSubscribeResultsUserCallbacks;
   std::vector<AsyncMqttClientInternals::OnUnsubscribeUserCallback> _onUnsubscribeUserCallbacks;
   std::vector<AsyncMqttClientInternals::OnMessageUserCallback> _onMessageUserCallbacks;
+  AsyncMqttClientInternals::TopicTrie _topicRoutes;  // handlers and subscriptions by topic filter
+  std::vector<AsyncMqttClientInternals::TopicRoute*> _messageRoutes;  // matched by the message being received
   std::vector<AsyncMqttClientInternals::OnPublishUserCallback> _onPublishUserCallbacks;
+  std::vector<AsyncMqttClientInternals::OnErrorUserCallback> _onErrorUserCallbacks;
+  std::vector<AsyncMqttClientInternals::OnWritableUserCallback> _onWritableUserCallbacks;
 
   AsyncMqttClientInternals::ParsingInformation _parsingInformation;
-  AsyncMqttClientInternals::Packet* _currentParsedPacket;
+  char* _reassemblyBuffer;  // payload of the message being received, reused for every message
+  size_t _reassemblySize;
+  AsyncMqttClientInternals::ParserStorage _parser;
+  AsyncMqttClientInternals::Packet* _currentParsedPacket;  // in _parser, or nullptr
   uint8_t _remainingLengthBufferPosition;
   char _remainingLengthBuffer[4];
 
-  std::vector<AsyncMqttClientInternals::PendingPubRel> _pendingPubRels;
+  AsyncMqttClientInternals::PacketIdSet _pendingPubRels;  // incoming QoS 2 messages delivered, awaiting PUBREL
+
+  AsyncMqttClientSessionStore* _sessionStore;
+  size_t _sessionCompactSize;
+  size_t _journalSize;
+  bool _sessionCompactDue;  // an append failed, the journal misses a transition
 
 #if defined(ESP32)
   SemaphoreHandle_t _xSemaphore = nullptr;
@@ -154,26 +309,78 @@ class AsyncMqttClient {
   // void _onTimeout();
   void _onAck(size_t len);
   void _onData(char* data, size_t len);
+  size_t _parseInPlace(char* data, size_t len);
   void _onPoll();
 
+  // DNS
+  void _pickServer();
+  void _resolve();
+  void _takeResolved();
+  void _cancelResolve();
+
+  // RECONNECT
+  void _scheduleReconnect(bool wasConnected);
+  void _cancelReconnect();
+  static void _onReconnectTimer(AsyncMqttClient* client);
+  void _armFlush();
+  static void _onFlushTimer(AsyncMqttClient* client);
+  void _flush();
+
   // QUEUE
-  void _insert(AsyncMqttClientInternals::OutPacket* packet);    // for PUBREL
+  bool _canQueue() const;
   void _addFront(AsyncMqttClientInternals::OutPacket* packet);  // for CONNECT
   void _addBack(AsyncMqttClientInternals::OutPacket* packet);   // all the rest
+  void _enqueue(AsyncMqttClientInternals::OutPacket* packet);
+  uint8_t _laneOf(const AsyncMqttClientInternals::OutPacket* packet) const;
+  uint8_t _nextLane() const;
   void _handleQueue();
+  void _prepareProperties(AsyncMqttClientInternals::OutPacket* packet);  // caller holds the lock
   void _clearQueue(bool keepSessionData);
+  void _releaseTcpAcked(bool all);
+  bool _admit(size_t size);
+  bool _belowLowWater() const;
+  bool _writableAgain();
+  uint16_t _allocatePacketId();
+  void _releasePacketId(const AsyncMqttClientInternals::OutPacket* packet);  // caller holds the lock
+
+  // IN-FLIGHT
+  bool _hasInflightSlot(const AsyncMqttClientInternals::OutPacket* packet) const;
+  bool _addInflight(AsyncMqttClientInternals::OutPacket* packet);
+  AsyncMqttClientInternals::OutPacket* _findInflight(uint8_t packetType, uint16_t packetId);
+  AsyncMqttClientInternals::OutPacket* _takePendingSubAck(uint8_t packetType, uint16_t packetId);
+  bool _takeInflight(AsyncMqttClientInternals::OutPacket* packet);
+
+  // RETRANSMISSION (caller holds the lock)
+  void _armTimer(AsyncMqttClientInternals::OutPacket* packet);
+  void _disarmTimer(AsyncMqttClientInternals::OutPacket* packet);
+  void _clearTimers();
+  bool _forget(AsyncMqttClientInternals::OutPacket* packet);
+  void _requeue(AsyncMqttClientInternals::OutPacket* packet);
+  bool _unlink(AsyncMqttClientInternals::OutPacket* packet);
+  bool _retransmits() const;
+  void _handleTimers();
 
   // MQTT
   void _onPingResp();
   void _onConnAck(bool sessionPresent, uint8_t connectReturnCode);
-  void _onSubAck(uint16_t packetId, char status);
+  void _onConnAckProperty(uint8_t id, uint32_t value);
+  void _replaySubscriptions(bool sessionPresent);
+  void _onSubAck(uint16_t packetId, const uint8_t* returnCodes, size_t count);
   void _onUnsubAck(uint16_t packetId);
   void _onMessage(char* topic, char* payload, uint8_t qos, bool dup, bool retain, size_t len, size_t index, size_t total, uint16_t packetId);
   void _onPublish(uint16_t packetId, uint8_t qos);
   void _onPubRel(uint16_t packetId);
   void _onPubAck(uint16_t packetId);
-  void _onPubRec(uint16_t packetId);
+  void _onPubRec(uint16_t packetId, uint8_t reasonCode);
   void _onPubComp(uint16_t packetId);
+  void _onDisconnectPacket(uint8_t reasonCode);
+  void _closeConnection(AsyncMqttClientDisconnectReason reason);  // unlike disconnect(), the reconnect engine carries on
 
   void _sendPing();
+
+  // SESSION (caller holds the lock)
+  bool _appendSessionRecord(uint8_t record, uint16_t packetId, const AsyncMqttClientInternals::OutPacket* packet = nullptr);
+  void _journal(uint8_t record, uint16_t packetId, const AsyncMqttClientInternals::OutPacket* packet = nullptr);
+  void _compactSession(bool force);
+  void _restoreSession();
 };
@@ -11,20 +11,12 @@ namespace AsyncMqttClientInternals {
 typedef std::function<void(bool sessionPresent)> OnConnectUserCallback;
 typedef std::function<void(AsyncMqttClientDisconnectReason reason)> OnDisconnectUserCallback;
 typedef std::function<void(uint16_t packetId, uint8_t qos)> OnSubscribeUserCallback;
+typedef std::function<void(uint16_t packetId, const uint8_t* returnCodes, size_t count)> OnSubscribeResultsUserCallback;
 typedef std::function<void(uint16_t packetId)> OnUnsubscribeUserCallback;
 typedef std::function<void(char* topic, char* payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total)> OnMessageUserCallback;
 typedef std::function<void(uint16_t packetId)> OnPublishUserCallback;
 typedef std::function<void(uint16_t packetId, AsyncMqttClientError error)> OnErrorUserCallback;
-
-// internal callbacks
-typedef std::function<void(bool sessionPresent, uint8_t connectReturnCode)> OnConnAckInternalCallback;
-typedef std::function<void()> OnPingRespInternalCallback;
-typedef std::function<void(uint16_t packetId, char status)> OnSubAckInternalCallback;
-typedef std::function<void(uint16_t packetId)> OnUnsubAckInternalCallback;
-typedef std::function<void(char* topic, char* payload, uint8_t qos, bool dup, bool retain, size_t len, size_t index, size_t total, uint16_t packetId)> OnMessageInternalCallback;
-typedef std::function<void(uint16_t packetId, uint8_t qos)> OnPublishInternalCallback;
-typedef std::function<void(uint16_t packetId)> OnPubRelInternalCallback;
-typedef std::function<void(uint16_t packetId)> OnPubAckInternalCallback;
-typedef std::function<void(uint16_t packetId)> OnPubRecInternalCallback;
-typedef std::function<void(uint16_t packetId)> OnPubCompInternalCallback;
+typedef std::function<void(const char* payload, size_t length)> OnPayloadReleaseUserCallback;
+typedef std::function<size_t(uint8_t* buffer, size_t maxLength, size_t index)> OnPayloadChunkUserCallback;
+typedef std::function<void()> OnWritableUserCallback;
 }  // namespace AsyncMqttClientInternals
@@ -11,5 +11,8 @@ enum class AsyncMqttClientDisconnectReason : uint8_t {
 
   ESP8266_NOT_ENOUGH_SPACE = 6,
 
-  TLS_BAD_FINGERPRINT = 7
+  TLS_BAD_FINGERPRINT = 7,
+
+  MQTT_PROTOCOL_ERROR = 8,       // malformed or unexpected packet from the server
+  MQTT_SERVER_DISCONNECTED = 9   // MQTT 5.0 DISCONNECT from the server
 };
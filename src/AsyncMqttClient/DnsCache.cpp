@@ -0,0 +1,56 @@
+#include "DnsCache.hpp"
+
+using AsyncMqttClientInternals::DnsCache;
+
+DnsCache::DnsCache()
+: _addresses()
+, _size(0)
+, _resolvedAt(0) {
+  static_assert(MQTT_DNS_CACHE_ADDRESSES > 0, "MQTT_DNS_CACHE_ADDRESSES must be positive");
+}
+
+void DnsCache::clear() {
+  _size = 0;
+}
+
+void DnsCache::add(IPAddress address, uint32_t now) {
+  _resolvedAt = now;
+  size_t index = 0;
+  while (index < _size && !(_addresses[index] == address)) index++;
+  if (index == _size) {
+    // a new address, the oldest one makes room
+    if (_size < MQTT_DNS_CACHE_ADDRESSES) _size++;
+    index = _size - 1;
+    _addresses[index] = address;
+  }
+  _moveToFront(index);
+}
+
+void DnsCache::promote(IPAddress address) {
+  for (size_t index = 0; index < _size; index++) {
+    if (_addresses[index] == address) {
+      _moveToFront(index);
+      return;
+    }
+  }
+}
+
+bool DnsCache::get(size_t index, IPAddress* address) const {
+  if (index >= _size) return false;
+  *address = _addresses[index];
+  return true;
+}
+
+size_t DnsCache::size() const {
+  return _size;
+}
+
+bool DnsCache::stale(uint32_t now) const {
+  return _size == 0 || now - _resolvedAt >= MQTT_DNS_CACHE_TTL;
+}
+
+void DnsCache::_moveToFront(size_t index) {
+  IPAddress address = _addresses[index];
+  for (; index > 0; index--) _addresses[index] = _addresses[index - 1];
+  _addresses[0] = address;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint*_t
+
+#include "Arduino.h"  // IPAddress
+
+// How long a lookup is trusted, in ms. lwIP does not hand out the TTL of the
+// record, it only honours it in its own table, which a new lookup goes through.
+#ifndef MQTT_DNS_CACHE_TTL
+#define MQTT_DNS_CACHE_TTL 300000
+#endif
+
+// Addresses kept per host, the most recently resolved or connected first
+#ifndef MQTT_DNS_CACHE_ADDRESSES
+#define MQTT_DNS_CACHE_ADDRESSES 3
+#endif
+
+namespace AsyncMqttClientInternals {
+// Resolved addresses of the server host. A stale entry is still used while a
+// new lookup runs in the background: the previous address is right far more
+// often than the lookup is fast.
+class DnsCache {
+ public:
+  DnsCache();
+  void clear();                              // the host changed
+  void add(IPAddress address, uint32_t now);  // a fresh lookup result
+  void promote(IPAddress address);            // a connection to it succeeded
+  bool get(size_t index, IPAddress* address) const;
+  size_t size() const;
+  bool stale(uint32_t now) const;             // empty, or the last lookup is older than MQTT_DNS_CACHE_TTL
+
+ private:
+  void _moveToFront(size_t index);
+
+  IPAddress _addresses[MQTT_DNS_CACHE_ADDRESSES];
+  size_t _size;
+  uint32_t _resolvedAt;
+};
+}  // namespace AsyncMqttClientInternals
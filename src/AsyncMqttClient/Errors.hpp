@@ -2,5 +2,10 @@
 
 enum class AsyncMqttClientError : uint8_t {
   MAX_RETRIES = 0,
-  OUT_OF_MEMORY = 1
+  OUT_OF_MEMORY = 1,
+  QUEUE_FULL = 2,
+  PACKET_TOO_LARGE = 3,
+  SESSION_RECORD_DROPPED = 4,
+  NO_PACKET_ID = 5,
+  PUBLISH_REFUSED = 6
 };
@@ -0,0 +1,121 @@
+#include "FileSessionStore.hpp"
+
+#include <stdlib.h>  // malloc
+#include <string.h>  // strlen
+#include <vector>
+#if !defined(ESP8266)
+#include <unistd.h>  // fsync
+#endif
+
+AsyncMqttClientFileSessionStore::AsyncMqttClientFileSessionStore(const char* path, uint8_t syncRecords)
+: _path(nullptr)
+, _tmpPath(nullptr)
+, _syncRecords(syncRecords)
+, _unsynced(0)
+, _file(nullptr)
+, _rewriting(false) {
+  size_t length = strlen(path);
+  _path = static_cast<char*>(malloc(length + 1));
+  _tmpPath = static_cast<char*>(malloc(length + 4 + 1));
+  memcpy(_path, path, length + 1);
+  memcpy(_tmpPath, path, length);
+  memcpy(_tmpPath + length, ".tmp", 4 + 1);
+}
+
+AsyncMqttClientFileSessionStore::~AsyncMqttClientFileSessionStore() {
+  if (_file) fclose(_file);
+  free(_path);
+  free(_tmpPath);
+}
+
+bool AsyncMqttClientFileSessionStore::append(const uint8_t* data, size_t length) {
+  AsyncMqttClientSessionRecordPart part = {data, length};
+  return append(&part, 1);
+}
+
+bool AsyncMqttClientFileSessionStore::append(const AsyncMqttClientSessionRecordPart* parts, size_t count) {
+  if (!_file) _file = fopen(_path, "ab");
+  if (!_file) return false;
+
+  size_t length = 0;
+  for (size_t i = 0; i < count; i++) length += parts[i].length;
+  uint8_t header[4];
+  header[0] = length & 0xFF;
+  header[1] = (length >> 8) & 0xFF;
+  header[2] = (length >> 16) & 0xFF;
+  header[3] = (length >> 24) & 0xFF;
+  if (fwrite(header, 1, sizeof(header), _file) != sizeof(header)) return false;
+  for (size_t i = 0; i < count; i++) {
+    if (fwrite(parts[i].data, 1, parts[i].length, _file) != parts[i].length) return false;
+  }
+  if (_rewriting) return true;  // a rewrite is flushed once, on commit
+  if (_unsynced < UINT8_MAX) _unsynced++;
+  return _syncRecords == 0 || _unsynced < _syncRecords || _flush();
+}
+
+void AsyncMqttClientFileSessionStore::sync() {
+  if (_file && !_rewriting && _unsynced > 0) _flush();
+}
+
+void AsyncMqttClientFileSessionStore::replay(OnSessionRecordCallback callback) {
+  if (_file && !_rewriting) fflush(_file);  // records still buffered
+  FILE* file = fopen(_path, "rb");
+  if (!file) return;
+  long size = (fseek(file, 0, SEEK_END) == 0) ? ftell(file) : -1;
+  if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+    fclose(file);
+    return;
+  }
+
+  std::vector<uint8_t> record;
+  uint8_t header[4];
+  size_t remaining = size;
+  while (remaining >= sizeof(header) && fread(header, 1, sizeof(header), file) == sizeof(header)) {
+    remaining -= sizeof(header);
+    size_t length = header[0] | header[1] << 8 | header[2] << 16 | static_cast<uint32_t>(header[3]) << 24;
+    if (length > remaining) break;  // torn by a power loss, or a corrupt length
+    remaining -= length;
+    record.resize(length);
+    if (fread(record.data(), 1, length, file) != length) break;  // torn by a power loss
+    callback(record.data(), length);
+  }
+  fclose(file);
+}
+
+bool AsyncMqttClientFileSessionStore::beginRewrite() {
+  if (_file) fclose(_file);
+  _file = fopen(_tmpPath, "wb");
+  _rewriting = (_file != nullptr);
+  return _rewriting;
+}
+
+bool AsyncMqttClientFileSessionStore::commitRewrite() {
+  if (!_rewriting) return false;
+  if (!_flush()) return false;  // still rewriting, the client aborts
+  _rewriting = false;
+  fclose(_file);
+  _file = nullptr;
+  if (rename(_tmpPath, _path) != 0) {
+    // some embedded file systems do not replace an existing file
+    remove(_path);
+    return rename(_tmpPath, _path) == 0;
+  }
+  return true;
+}
+
+void AsyncMqttClientFileSessionStore::abortRewrite() {
+  if (!_rewriting) return;
+  _rewriting = false;
+  fclose(_file);
+  _file = nullptr;  // the journal is opened again on the next append
+  remove(_tmpPath);
+}
+
+bool AsyncMqttClientFileSessionStore::_flush() {
+  if (fflush(_file) != 0) return false;
+#if !defined(ESP8266)
+  if (fsync(fileno(_file)) != 0) return false;
+#endif
+  _unsynced = 0;
+  return true;
+}
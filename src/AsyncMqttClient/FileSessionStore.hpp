@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdio.h>  // FILE
+
+#include "SessionStore.hpp"
+
+// Records appended before the file is flushed to the device, besides the flush on sync()
+#ifndef MQTT_SESSION_SYNC_RECORDS
+#define MQTT_SESSION_SYNC_RECORDS 16
+#endif
+
+// Session journal in a file, for Linux hosts or a mounted SPIFFS/LittleFS/SD file system.
+// Records are length-prefixed and only ever appended; a rewrite goes to "<path>.tmp",
+// which is renamed over the journal once complete.
+class AsyncMqttClientFileSessionStore : public AsyncMqttClientSessionStore {
+ public:
+  // Records are flushed to the device every syncRecords appends and on sync(), at most half a
+  // second after they were appended while connected. 1 flushes every record before append
+  // returns, 0 only on sync().
+  explicit AsyncMqttClientFileSessionStore(const char* path, uint8_t syncRecords = MQTT_SESSION_SYNC_RECORDS);
+  ~AsyncMqttClientFileSessionStore();
+
+  bool append(const uint8_t* data, size_t length);
+  bool append(const AsyncMqttClientSessionRecordPart* parts, size_t count);
+  void sync();
+  void replay(OnSessionRecordCallback callback);
+  bool beginRewrite();
+  bool commitRewrite();
+  void abortRewrite();
+
+ private:
+  bool _flush();
+
+  char* _path;
+  char* _tmpPath;
+  uint8_t _syncRecords;
+  uint8_t _unsynced;  // records appended since the last flush
+  FILE* _file;  // opened on the first append
+  bool _rewriting;
+};
@@ -54,4 +54,18 @@ constexpr struct {
   const uint8_t CLEAN_SESSION = 0x02;
   const uint8_t RESERVED      = 0x00;
 } ConnectFlag;
+
+constexpr struct {
+  const uint8_t MQTT_3_1_1 = 0x04;
+  const uint8_t MQTT_5_0   = 0x05;
+} ProtocolLevel;
+
+// MQTT 5.0 property identifiers the client reads or writes
+constexpr struct {
+  const uint8_t SESSION_EXPIRY_INTERVAL = 0x11;
+  const uint8_t RECEIVE_MAXIMUM         = 0x21;
+  const uint8_t TOPIC_ALIAS_MAXIMUM     = 0x22;
+  const uint8_t TOPIC_ALIAS             = 0x23;
+  const uint8_t MAXIMUM_PACKET_SIZE     = 0x27;
+} Property;
 }  // namespace AsyncMqttClientInternals
@@ -0,0 +1,197 @@
+#include "FlashSessionStore.hpp"
+
+#include <vector>
+
+// half layout: magic and generation, then records of [length:2][checksum:2][data]
+static const uint32_t MAGIC = 0x514D4341;  // "ACMQ"
+static const size_t HEADER_SIZE = 8;
+static const size_t RECORD_HEADER_SIZE = 4;
+static const uint16_t ERASED = 0xFFFF;
+
+static uint16_t checksum(const uint8_t* data, size_t length, uint16_t sum = 0) {
+  // Fletcher-16, sum is the checksum of the preceding bytes
+  uint16_t sum1 = sum & 0xFF;
+  uint16_t sum2 = sum >> 8;
+  for (size_t i = 0; i < length; i++) {
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return sum2 << 8 | sum1;
+}
+
+#if defined(ESP32)
+AsyncMqttClientPartitionFlash::AsyncMqttClientPartitionFlash(const char* label)
+: _partition(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label)) {
+}
+
+bool AsyncMqttClientPartitionFlash::found() const {
+  return _partition != nullptr;
+}
+
+size_t AsyncMqttClientPartitionFlash::size() const {
+  return _partition ? _partition->size : 0;
+}
+
+size_t AsyncMqttClientPartitionFlash::sectorSize() const {
+  return SPI_FLASH_SEC_SIZE;
+}
+
+bool AsyncMqttClientPartitionFlash::read(size_t offset, uint8_t* data, size_t length) {
+  return _partition && esp_partition_read(_partition, offset, data, length) == ESP_OK;
+}
+
+bool AsyncMqttClientPartitionFlash::write(size_t offset, const uint8_t* data, size_t length) {
+  return _partition && esp_partition_write(_partition, offset, data, length) == ESP_OK;
+}
+
+bool AsyncMqttClientPartitionFlash::erase(size_t offset, size_t length) {
+  return _partition && esp_partition_erase_range(_partition, offset, length) == ESP_OK;
+}
+#endif
+
+AsyncMqttClientFlashSessionStore::AsyncMqttClientFlashSessionStore(AsyncMqttClientFlash* flash)
+: _flash(flash)
+, _halfSize((flash->size() / 2) / flash->sectorSize() * flash->sectorSize())
+, _mounted(false)
+, _active(2)
+, _generation(0)
+, _writeOffset(0)
+, _rewriting(false) {
+}
+
+bool AsyncMqttClientFlashSessionStore::append(const uint8_t* data, size_t length) {
+  AsyncMqttClientSessionRecordPart part = {data, length};
+  return append(&part, 1);
+}
+
+bool AsyncMqttClientFlashSessionStore::append(const AsyncMqttClientSessionRecordPart* parts, size_t count) {
+  if (!_mount()) return false;
+  if (_active == 2 && !_rewriting) {
+    // first record ever, start the journal with an empty rewrite
+    if (!beginRewrite() || !commitRewrite()) {
+      abortRewrite();
+      return false;
+    }
+  }
+  size_t length = 0;
+  uint16_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    length += parts[i].length;
+    sum = checksum(parts[i].data, parts[i].length, sum);
+  }
+  if (length >= ERASED || _writeOffset + RECORD_HEADER_SIZE + length > _halfSize) return false;
+
+  uint8_t half = _rewriting ? 1 - _active % 2 : _active;
+  size_t offset = _halfOffset(half) + _writeOffset;
+  uint8_t header[RECORD_HEADER_SIZE] = {
+    static_cast<uint8_t>(length & 0xFF), static_cast<uint8_t>(length >> 8),
+    static_cast<uint8_t>(sum & 0xFF), static_cast<uint8_t>(sum >> 8)
+  };
+  // the data goes first, a record only exists once its header is written
+  size_t dataOffset = offset + RECORD_HEADER_SIZE;
+  for (size_t i = 0; i < count; i++) {
+    if (!_flash->write(dataOffset, parts[i].data, parts[i].length)) return false;
+    dataOffset += parts[i].length;
+  }
+  if (!_flash->write(offset, header, RECORD_HEADER_SIZE)) return false;
+  _writeOffset += RECORD_HEADER_SIZE + length;
+  return true;
+}
+
+void AsyncMqttClientFlashSessionStore::replay(OnSessionRecordCallback callback) {
+  if (!_mount() || _active == 2) return;
+  _scan(_active, callback);
+}
+
+bool AsyncMqttClientFlashSessionStore::beginRewrite() {
+  if (!_mount()) return false;
+  uint8_t half = 1 - _active % 2;
+  _rewriting = true;  // from here on the half being written is dirty, a failure has to be aborted
+  _writeOffset = HEADER_SIZE;
+  return _flash->erase(_halfOffset(half), _halfSize);
+}
+
+bool AsyncMqttClientFlashSessionStore::commitRewrite() {
+  if (!_rewriting) return false;
+  uint8_t half = 1 - _active % 2;
+  uint32_t generation = _generation + 1;
+  uint8_t header[HEADER_SIZE];
+  for (uint8_t i = 0; i < 4; i++) {
+    header[i] = (MAGIC >> (8 * i)) & 0xFF;
+    header[4 + i] = (generation >> (8 * i)) & 0xFF;
+  }
+  if (!_flash->write(_halfOffset(half), header, HEADER_SIZE)) return false;  // still rewriting, the client aborts
+  _rewriting = false;
+  _active = half;
+  _generation = generation;
+  return true;
+}
+
+void AsyncMqttClientFlashSessionStore::abortRewrite() {
+  if (!_rewriting) return;
+  _rewriting = false;
+  // back to the end of the current journal, the half of the rewrite is erased by the next one
+  _writeOffset = (_active == 2) ? 0 : _end(_active);
+}
+
+bool AsyncMqttClientFlashSessionStore::_mount() {
+  if (_mounted) return true;
+  if (_halfSize < HEADER_SIZE + RECORD_HEADER_SIZE) return false;
+  uint32_t generations[2];
+  bool valid[2] = { _readHeader(0, &generations[0]), _readHeader(1, &generations[1]) };
+  if (valid[0] && valid[1]) {
+    _active = (static_cast<int32_t>(generations[1] - generations[0]) > 0) ? 1 : 0;
+  } else if (valid[0] || valid[1]) {
+    _active = valid[0] ? 0 : 1;
+  }
+  if (_active != 2) {
+    _generation = generations[_active];
+    _writeOffset = _end(_active);
+  }
+  _mounted = true;
+  return true;
+}
+
+bool AsyncMqttClientFlashSessionStore::_readHeader(uint8_t half, uint32_t* generation) {
+  uint8_t header[HEADER_SIZE];
+  if (!_flash->read(_halfOffset(half), header, HEADER_SIZE)) return false;
+  uint32_t magic = 0;
+  *generation = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    magic |= static_cast<uint32_t>(header[i]) << (8 * i);
+    *generation |= static_cast<uint32_t>(header[4 + i]) << (8 * i);
+  }
+  return magic == MAGIC;
+}
+
+size_t AsyncMqttClientFlashSessionStore::_end(uint8_t half) {
+  size_t offset = _scan(half, nullptr);
+  uint8_t end[2] = {0, 0};
+  if (offset + 2 <= _halfSize) _flash->read(_halfOffset(half) + offset, end, 2);
+  if ((end[0] & end[1]) != 0xFF) offset = _halfSize;  // torn record: full until the next rewrite
+  return offset;
+}
+
+size_t AsyncMqttClientFlashSessionStore::_scan(uint8_t half, OnSessionRecordCallback callback) {
+  // returns the offset after the last valid record
+  size_t base = _halfOffset(half);
+  size_t offset = HEADER_SIZE;
+  std::vector<uint8_t> record;
+  while (offset + RECORD_HEADER_SIZE <= _halfSize) {
+    uint8_t header[RECORD_HEADER_SIZE];
+    if (!_flash->read(base + offset, header, RECORD_HEADER_SIZE)) break;
+    uint16_t length = header[0] | header[1] << 8;
+    uint16_t sum = header[2] | header[3] << 8;
+    if (length == ERASED || offset + RECORD_HEADER_SIZE + length > _halfSize) break;
+    record.resize(length);
+    if (!_flash->read(base + offset + RECORD_HEADER_SIZE, record.data(), length)) break;
+    if (checksum(record.data(), length) != sum) break;  // header torn by a power loss
+    if (callback) callback(record.data(), length);
+    offset += RECORD_HEADER_SIZE + length;
+  }
+  return offset;
+}
+
+size_t AsyncMqttClientFlashSessionStore::_halfOffset(uint8_t half) const {
+  return half * _halfSize;
+}
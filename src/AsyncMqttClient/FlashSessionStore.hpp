@@ -0,0 +1,64 @@
+#pragma once
+
+#include "SessionStore.hpp"
+
+// Raw NOR flash region: erased bytes read as 0xFF and writes only clear bits.
+class AsyncMqttClientFlash {
+ public:
+  virtual ~AsyncMqttClientFlash() {}
+  virtual size_t size() const = 0;
+  virtual size_t sectorSize() const = 0;
+  virtual bool read(size_t offset, uint8_t* data, size_t length) = 0;
+  virtual bool write(size_t offset, const uint8_t* data, size_t length) = 0;
+  virtual bool erase(size_t offset, size_t length) = 0;  // whole sectors
+};
+
+#if defined(ESP32)
+#include <esp_partition.h>
+
+// Data partition from the partition table, e.g. a "mqtt" partition of subtype 0x99
+class AsyncMqttClientPartitionFlash : public AsyncMqttClientFlash {
+ public:
+  explicit AsyncMqttClientPartitionFlash(const char* label);
+  bool found() const;
+
+  size_t size() const;
+  size_t sectorSize() const;
+  bool read(size_t offset, uint8_t* data, size_t length);
+  bool write(size_t offset, const uint8_t* data, size_t length);
+  bool erase(size_t offset, size_t length);
+
+ private:
+  const esp_partition_t* _partition;
+};
+#endif
+
+// Log-structured session journal on raw flash. The region is split in two halves used in turns:
+// records are appended to the active half, a rewrite erases and fills the other one, and
+// committing it writes its header with a higher generation. No sector is erased on append.
+class AsyncMqttClientFlashSessionStore : public AsyncMqttClientSessionStore {
+ public:
+  explicit AsyncMqttClientFlashSessionStore(AsyncMqttClientFlash* flash);
+
+  bool append(const uint8_t* data, size_t length);
+  bool append(const AsyncMqttClientSessionRecordPart* parts, size_t count);
+  void replay(OnSessionRecordCallback callback);
+  bool beginRewrite();
+  bool commitRewrite();
+  void abortRewrite();
+
+ private:
+  bool _mount();
+  size_t _end(uint8_t half);
+  bool _readHeader(uint8_t half, uint32_t* generation);
+  size_t _scan(uint8_t half, OnSessionRecordCallback callback);
+  size_t _halfOffset(uint8_t half) const;
+
+  AsyncMqttClientFlash* _flash;
+  size_t _halfSize;
+  bool _mounted;
+  uint8_t _active;      // half holding the journal, 2 if there is none yet
+  uint32_t _generation;
+  size_t _writeOffset;  // within the half being written
+  bool _rewriting;
+};
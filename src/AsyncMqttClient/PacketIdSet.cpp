@@ -0,0 +1,72 @@
+#include "PacketIdSet.hpp"
+
+#include <cstring>  // memset
+
+using AsyncMqttClientInternals::PacketIdSet;
+
+PacketIdSet::PacketIdSet()
+: _slots()
+, _size(0)
+, _highWater(0) {
+  static_assert(MQTT_PENDING_PUBREL_SLOTS > 1 && (MQTT_PENDING_PUBREL_SLOTS & (MQTT_PENDING_PUBREL_SLOTS - 1)) == 0,
+                "MQTT_PENDING_PUBREL_SLOTS must be a power of two");
+}
+
+bool PacketIdSet::insert(uint16_t packetId) {
+  if (packetId == 0) return false;
+  size_t slot = _find(packetId);
+  if (_slots[slot] == packetId) return true;
+  if (_size >= SLOTS - 1) return false;  // keeps a free slot, probes always end
+  _slots[slot] = packetId;
+  if (++_size > _highWater) _highWater = _size;
+  return true;
+}
+
+bool PacketIdSet::contains(uint16_t packetId) const {
+  return packetId != 0 && _slots[_find(packetId)] == packetId;
+}
+
+bool PacketIdSet::erase(uint16_t packetId) {
+  if (packetId == 0) return false;
+  size_t slot = _find(packetId);
+  if (_slots[slot] != packetId) return false;
+  // shift the following entries of the probe sequence back, no tombstones needed
+  size_t next = slot;
+  while (true) {
+    next = (next + 1) & (SLOTS - 1);
+    if (_slots[next] == 0) break;
+    size_t home = _home(_slots[next]);
+    // move it unless its home lies cyclically in (slot, next]
+    bool stays = (slot <= next) ? (slot < home && home <= next) : (slot < home || home <= next);
+    if (!stays) {
+      _slots[slot] = _slots[next];
+      slot = next;
+    }
+  }
+  _slots[slot] = 0;
+  _size--;
+  return true;
+}
+
+void PacketIdSet::clear() {
+  memset(_slots, 0, sizeof(_slots));
+  _size = 0;
+}
+
+uint16_t PacketIdSet::size() const {
+  return _size;
+}
+
+uint16_t PacketIdSet::highWater() const {
+  return _highWater;
+}
+
+size_t PacketIdSet::_home(uint16_t packetId) {
+  return packetId & (SLOTS - 1);  // brokers mostly number their messages in sequence
+}
+
+size_t PacketIdSet::_find(uint16_t packetId) const {
+  size_t slot = _home(packetId);
+  while (_slots[slot] != 0 && _slots[slot] != packetId) slot = (slot + 1) & (SLOTS - 1);
+  return slot;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>  // uint*_t
+#include <stddef.h>  // size_t
+
+// Slots of the set of incoming QoS 2 messages waiting for PUBREL, a power of two.
+// Costs two bytes each, one slot always stays free.
+#ifndef MQTT_PENDING_PUBREL_SLOTS
+#define MQTT_PENDING_PUBREL_SLOTS 128
+#endif
+
+namespace AsyncMqttClientInternals {
+// Fixed size set of packet IDs: an open addressing table with linear probing,
+// 0 marks a free slot. Insert, lookup and erase are O(1) on average.
+class PacketIdSet {
+ public:
+  PacketIdSet();
+  bool insert(uint16_t packetId);  // false if the set is full
+  bool contains(uint16_t packetId) const;
+  bool erase(uint16_t packetId);   // false if it was not in the set
+  void clear();
+  uint16_t size() const;
+  uint16_t highWater() const;
+
+  template <typename Visitor>
+  void forEach(Visitor visit) const {
+    for (uint16_t packetId : _slots) {
+      if (packetId != 0) visit(packetId);
+    }
+  }
+
+ private:
+  static const size_t SLOTS = MQTT_PENDING_PUBREL_SLOTS;
+  static size_t _home(uint16_t packetId);
+  size_t _find(uint16_t packetId) const;  // its slot, or the free slot ending its probe sequence
+
+  uint16_t _slots[SLOTS];
+  uint16_t _size;
+  uint16_t _highWater;
+};
+}  // namespace AsyncMqttClientInternals
@@ -0,0 +1,104 @@
+#include "PacketIds.hpp"
+
+#include <cstring>  // memset
+
+using AsyncMqttClientInternals::PacketIds;
+
+static const uint16_t SEQUENCES = 65535;  // packet ID 0 is not allowed
+
+static uint16_t nextSequence(uint16_t sequence) {
+  return (sequence == SEQUENCES - 1) ? 0 : sequence + 1;
+}
+
+PacketIds::PacketIds()
+: _bits()
+, _base(0)
+, _baseBit(0)
+, _next(0)
+, _used(0) {
+  static_assert(MQTT_PACKET_ID_WINDOW % 32 == 0 && MQTT_PACKET_ID_WINDOW > 0 && MQTT_PACKET_ID_WINDOW < SEQUENCES,
+                "MQTT_PACKET_ID_WINDOW must be a multiple of 32 below 65535");
+}
+
+uint16_t PacketIds::allocate() {
+  if (_offset(_next) >= WINDOW) return _reuse();
+  uint16_t sequence = _next;
+  _flip(sequence);
+  _used++;
+  _next = nextSequence(_next);
+  return sequence + 1;
+}
+
+void PacketIds::release(uint16_t packetId) {
+  if (packetId == 0) return;
+  uint16_t sequence = packetId - 1;
+  if (_offset(sequence) >= _offset(_next) || !_test(sequence)) return;  // not in use
+  _flip(sequence);
+  _used--;
+  // slide the window past the IDs released at its start
+  while (_base != _next && !_test(_base)) {
+    _base = nextSequence(_base);
+    _baseBit = (_baseBit + 1) % WINDOW;
+  }
+}
+
+bool PacketIds::reserve(uint16_t packetId) {
+  if (packetId == 0) return false;
+  uint16_t sequence = packetId - 1;
+  if (_used == 0) {
+    _base = sequence;
+    _baseBit = 0;
+    _next = sequence;
+  }
+  uint16_t offset = _offset(sequence);
+  if (offset >= WINDOW) return false;
+  if (offset >= _offset(_next)) {
+    _next = nextSequence(sequence);  // the skipped IDs are free, they are slid over once the window moves
+  } else if (_test(sequence)) {
+    return true;
+  }
+  _flip(sequence);
+  _used++;
+  return true;
+}
+
+uint16_t PacketIds::_reuse() {
+  // The oldest ID pins the window: look for an ID freed behind _next. Every
+  // bit of the ring stands for an ID of the window, whichever holds _base.
+  if (_used >= WINDOW) return 0;
+  for (uint16_t word = 0; word < WINDOW / 32; word++) {
+    if (_bits[word] == 0xFFFFFFFFUL) continue;
+    uint16_t bit = word * 32;
+    while (_bits[word] & (1UL << (bit % 32))) bit++;
+    uint16_t sequence = (static_cast<uint32_t>(_base) + (bit + WINDOW - _baseBit) % WINDOW) % SEQUENCES;
+    _flip(sequence);
+    _used++;
+    return sequence + 1;
+  }
+  return 0;
+}
+
+void PacketIds::clear() {
+  memset(_bits, 0, sizeof(_bits));
+  _base = _next;  // carry on from the last ID rather than reusing it right away
+  _baseBit = 0;
+  _used = 0;
+}
+
+uint16_t PacketIds::used() const {
+  return _used;
+}
+
+uint16_t PacketIds::_offset(uint16_t sequence) const {
+  return (static_cast<uint32_t>(sequence) + SEQUENCES - _base) % SEQUENCES;
+}
+
+bool PacketIds::_test(uint16_t sequence) const {
+  uint16_t bit = (_baseBit + _offset(sequence)) % WINDOW;
+  return _bits[bit / 32] & (1UL << (bit % 32));
+}
+
+void PacketIds::_flip(uint16_t sequence) {
+  uint16_t bit = (_baseBit + _offset(sequence)) % WINDOW;
+  _bits[bit / 32] ^= (1UL << (bit % 32));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>  // uint*_t
+
+// Span of packet IDs which can be in use at once, a multiple of 32. Costs one bit each.
+#ifndef MQTT_PACKET_ID_WINDOW
+#define MQTT_PACKET_ID_WINDOW 1024
+#endif
+
+namespace AsyncMqttClientInternals {
+// Packet IDs of one client. IDs are handed out in order, 1 to 65535 and around
+// again; an ID in use is never handed out twice. Only IDs within the window
+// after the oldest one still in use can be allocated, which keeps the
+// occupancy bitmap small. Once the window is used up to its end while its
+// oldest ID stays in use, the IDs freed behind it are handed out again.
+// Allocation and release are O(1), amortized, a scan of the bitmap otherwise.
+class PacketIds {
+ public:
+  PacketIds();
+  uint16_t allocate();  // 0 if all IDs of the window are in use
+  void release(uint16_t packetId);
+  bool reserve(uint16_t packetId);  // mark an ID restored from a session as used, false if it is out of the window
+  void clear();
+  uint16_t used() const;
+
+ private:
+  uint16_t _reuse();
+  uint16_t _offset(uint16_t sequence) const;
+  bool _test(uint16_t sequence) const;
+  void _flip(uint16_t sequence);
+
+  static const uint16_t WINDOW = MQTT_PACKET_ID_WINDOW;
+  uint32_t _bits[WINDOW / 32];  // ring of bits, _baseBit holds _base
+  uint16_t _base;     // oldest sequence number which may be in use, the ID is the sequence number + 1
+  uint16_t _baseBit;
+  uint16_t _next;     // sequence number handed out next, none from it on is in use
+  uint16_t _used;
+};
+}  // namespace AsyncMqttClientInternals
@@ -1,13 +1,16 @@
 #include "ConnAckPacket.hpp"
+#include "../../AsyncMqttClient.hpp"
 
 using AsyncMqttClientInternals::ConnAckPacket;
 
-ConnAckPacket::ConnAckPacket(ParsingInformation* parsingInformation, OnConnAckInternalCallback callback)
+ConnAckPacket::ConnAckPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client)
 : _parsingInformation(parsingInformation)
-, _callback(callback)
+, _client(client)
 , _bytePosition(0)
 , _sessionPresent(false)
-, _connectReturnCode(0) {
+, _connectReturnCode(0)
+, _propertyLengthRead(false)
+, _properties() {
 }
 
 ConnAckPacket::~ConnAckPacket() {
@@ -19,12 +22,25 @@ void ConnAckPacket::parseVariableHeader(char* data, size_t len, size_t* currentB
     _sessionPresent = (currentByte << 7) >> 7;
   } else {
     _connectReturnCode = currentByte;
-    _parsingInformation->bufferState = BufferState::NONE;
-    _callback(_sessionPresent, _connectReturnCode);
+    if (_parsingInformation->remainingLength > 2) {
+      _parsingInformation->bufferState = BufferState::PAYLOAD;  // MQTT 5.0 properties
+    } else {
+      _parsingInformation->bufferState = BufferState::NONE;
+      _client->_onConnAck(_sessionPresent, _connectReturnCode);
+    }
   }
 }
 
 void ConnAckPacket::parsePayload(char* data, size_t len, size_t* currentBytePosition) {
-  (void)data;
-  (void)currentBytePosition;
+  // the property length is not needed, the properties end with the packet
+  uint8_t currentByte = data[(*currentBytePosition)++];
+  _bytePosition++;
+  if (!_propertyLengthRead) {
+    _propertyLengthRead = (currentByte & 0x80) == 0;
+  } else if (_properties.feed(currentByte)) {
+    _client->_onConnAckProperty(_properties.id(), _properties.value());
+  }
+  if (_bytePosition < _parsingInformation->remainingLength) return;
+  _parsingInformation->bufferState = BufferState::NONE;
+  _client->_onConnAck(_sessionPresent, _connectReturnCode);
 }
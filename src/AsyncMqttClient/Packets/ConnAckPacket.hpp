@@ -2,13 +2,14 @@
 
 #include "Arduino.h"
 #include "Packet.hpp"
+#include "../Flags.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
+#include "../Properties.hpp"
 
 namespace AsyncMqttClientInternals {
 class ConnAckPacket : public Packet {
  public:
-  explicit ConnAckPacket(ParsingInformation* parsingInformation, OnConnAckInternalCallback callback);
+  explicit ConnAckPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~ConnAckPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -16,10 +17,12 @@ class ConnAckPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnConnAckInternalCallback _callback;
+  AsyncMqttClient* _client;
 
-  uint8_t _bytePosition;
+  uint32_t _bytePosition;
   bool _sessionPresent;
   uint8_t _connectReturnCode;
+  bool _propertyLengthRead;  // MQTT 5.0
+  PropertyReader _properties;
 };
 }  // namespace AsyncMqttClientInternals
@@ -0,0 +1,37 @@
+#include "DisconnectPacket.hpp"
+#include "../../AsyncMqttClient.hpp"
+
+#include <algorithm>  // std::min
+
+using AsyncMqttClientInternals::DisconnectPacket;
+
+DisconnectPacket::DisconnectPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client)
+: _parsingInformation(parsingInformation)
+, _client(client)
+, _bytePosition(0)
+, _reasonCode(0) {
+}
+
+DisconnectPacket::~DisconnectPacket() {
+}
+
+void DisconnectPacket::parseVariableHeader(char* data, size_t len, size_t* currentBytePosition) {
+  _reasonCode = data[(*currentBytePosition)++];
+  _bytePosition++;
+  if (_parsingInformation->remainingLength > 1) {
+    _parsingInformation->bufferState = BufferState::PAYLOAD;  // properties
+  } else {
+    _parsingInformation->bufferState = BufferState::NONE;
+    _client->_onDisconnectPacket(_reasonCode);
+  }
+}
+
+void DisconnectPacket::parsePayload(char* data, size_t len, size_t* currentBytePosition) {
+  // the properties are skipped
+  size_t chunk = std::min<size_t>(_parsingInformation->remainingLength - _bytePosition, len - (*currentBytePosition));
+  (*currentBytePosition) += chunk;
+  _bytePosition += chunk;
+  if (_bytePosition < _parsingInformation->remainingLength) return;
+  _parsingInformation->bufferState = BufferState::NONE;
+  _client->_onDisconnectPacket(_reasonCode);
+}
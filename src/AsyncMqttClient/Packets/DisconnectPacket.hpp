@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Arduino.h"
+#include "Packet.hpp"
+#include "../ParsingInformation.hpp"
+
+namespace AsyncMqttClientInternals {
+// MQTT 5.0 DISCONNECT sent by the server
+class DisconnectPacket : public Packet {
+ public:
+  explicit DisconnectPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
+  ~DisconnectPacket();
+
+  void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
+  void parsePayload(char* data, size_t len, size_t* currentBytePosition);
+
+ private:
+  ParsingInformation* _parsingInformation;
+  AsyncMqttClient* _client;
+
+  uint32_t _bytePosition;
+  uint8_t _reasonCode;
+};
+}  // namespace AsyncMqttClientInternals
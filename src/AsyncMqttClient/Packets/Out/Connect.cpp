@@ -11,7 +11,10 @@ ConnectOutPacket::ConnectOutPacket(bool cleanSession,
                                    const char* willPayload,
                                    uint16_t willPayloadLength,
                                    uint16_t keepAlive,
-                                   const char* clientId) {
+                                   const char* clientId,
+                                   uint8_t protocolLevel,
+                                   const uint8_t* properties,
+                                   uint8_t propertiesLength) {
   char fixedHeader[5];
   fixedHeader[0] = AsyncMqttClientInternals::PacketType.CONNECT;
   fixedHeader[0] = fixedHeader[0] << 4;
@@ -22,8 +25,10 @@ ConnectOutPacket::ConnectOutPacket(bool cleanSession,
   protocolNameLengthBytes[0] = protocolNameLength >> 8;
   protocolNameLengthBytes[1] = protocolNameLength & 0xFF;
 
-  char protocolLevel[1];
-  protocolLevel[0] = 0x04;
+  // MQTT 5.0 adds a property section after the keep alive and one before the will topic, both less than 128 bytes here
+  bool v5 = protocolLevel == AsyncMqttClientInternals::ProtocolLevel.MQTT_5_0;
+  uint8_t propertiesSize = v5 ? 1 + propertiesLength : 0;
+  uint8_t willPropertiesSize = (v5 && willTopic != nullptr) ? 1 : 0;
 
   char connectFlags[1];
   connectFlags[0] = 0;
@@ -86,7 +91,8 @@ ConnectOutPacket::ConnectOutPacket(bool cleanSession,
     passwordLengthBytes[1] = passwordLength & 0xFF;
   }
 
-  uint32_t remainingLength = 2 + protocolNameLength + 1 + 1 + 2 + 2 + clientIdLength;  // always present
+  uint32_t remainingLength = 2 + protocolNameLength + 1 + 1 + 2 + propertiesSize + 2 + clientIdLength;  // always present
+  remainingLength += willPropertiesSize;
   if (willTopic != nullptr) remainingLength += 2 + willTopicLength + 2 + willPayloadLength;
   if (username != nullptr) remainingLength += 2 + usernameLength;
   if (password != nullptr) remainingLength += 2 + passwordLength;
@@ -98,9 +104,11 @@ ConnectOutPacket::ConnectOutPacket(bool cleanSession,
   neededSpace += 1;
   neededSpace += 1;
   neededSpace += 2;
+  neededSpace += propertiesSize;
   neededSpace += 2;
   neededSpace += clientIdLength;
   if (willTopic != nullptr) {
+    neededSpace += willPropertiesSize;
     neededSpace += 2;
     neededSpace += willTopicLength;
 
@@ -128,15 +136,20 @@ ConnectOutPacket::ConnectOutPacket(bool cleanSession,
   _data.push_back('T');
   _data.push_back('T');
 
-  _data.push_back(protocolLevel[0]);
+  _data.push_back(protocolLevel);
   _data.push_back(connectFlags[0]);
   _data.push_back(keepAliveBytes[0]);
   _data.push_back(keepAliveBytes[1]);
+  if (v5) {
+    _data.push_back(propertiesLength);
+    _data.insert(_data.end(), properties, properties + propertiesLength);
+  }
   _data.push_back(clientIdLengthBytes[0]);
   _data.push_back(clientIdLengthBytes[1]);
 
   _data.insert(_data.end(), clientId, clientId + clientIdLength);
   if (willTopic != nullptr) {
+    if (willPropertiesSize > 0) _data.push_back(0);
     _data.insert(_data.end(), willTopicLengthBytes, willTopicLengthBytes + 2);
     _data.insert(_data.end(), willTopic, willTopic + willTopicLength);
 
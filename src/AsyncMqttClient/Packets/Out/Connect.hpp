@@ -19,7 +19,10 @@ class ConnectOutPacket : public OutPacket {
                    const char* willPayload,
                    uint16_t willPayloadLength,
                    uint16_t keepAlive,
-                   const char* clientId);
+                   const char* clientId,
+                   uint8_t protocolLevel,
+                   const uint8_t* properties,  // MQTT 5.0 CONNECT properties, without their length
+                   uint8_t propertiesLength);
   const uint8_t* data(size_t index = 0) const;
   size_t size() const;
 
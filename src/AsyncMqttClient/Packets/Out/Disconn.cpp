@@ -2,6 +2,8 @@
 
 using AsyncMqttClientInternals::DisconnOutPacket;
 
+static AsyncMqttClientInternals::Pool<sizeof(DisconnOutPacket), MQTT_POOL_CONTROL_PACKETS> pool;
+
 DisconnOutPacket::DisconnOutPacket() {
   _data[0] = AsyncMqttClientInternals::PacketType.DISCONNECT;
   _data[0] = _data[0] << 4;
@@ -16,3 +18,15 @@ const uint8_t* DisconnOutPacket::data(size_t index) const {
 size_t DisconnOutPacket::size() const {
   return 2;
 }
+
+void* DisconnOutPacket::operator new(size_t size) {
+  return pool.allocate(size);
+}
+
+void DisconnOutPacket::operator delete(void* p) {
+  pool.deallocate(p);
+}
+
+AsyncMqttClientPoolUsage DisconnOutPacket::poolUsage() {
+  return pool.usage();
+}
@@ -4,13 +4,32 @@ using AsyncMqttClientInternals::OutPacket;
 
 OutPacket::OutPacket()
 : next(nullptr)
+, sequence(0)
 , timeout(0)
 , noTries(0)
+, nextTimer(nullptr)
 , _released(true)
 , _packetId(0) {}
 
 OutPacket::~OutPacket() {}
 
+size_t OutPacket::available(size_t index) const {
+  return size() - index;
+}
+
+size_t OutPacket::pull(size_t index, size_t maxLength) {
+  return std::min(available(index), maxLength);
+}
+
+bool OutPacket::ownsData(size_t index) const {
+  (void)index;
+  return true;
+}
+
+bool OutPacket::persistent() const {
+  return false;
+}
+
 bool OutPacket::released() const {
   return _released;
 }
@@ -25,7 +44,7 @@ uint16_t OutPacket::packetId() const {
 
 uint8_t OutPacket::qos() const {
   if (packetType() == AsyncMqttClientInternals::PacketType.PUBLISH) {
-    return (data()[1] & 0x06) >> 1;
+    return (data()[0] & 0x06) >> 1;
   }
   return 0;
 }
@@ -33,12 +52,3 @@ uint8_t OutPacket::qos() const {
 void OutPacket::release() {
   _released = true;
 }
-
-uint16_t OutPacket::_nextPacketId = 0;
-
-uint16_t OutPacket::_getNextPacketId() {
-  if (++_nextPacketId == 0) {
-    ++_nextPacketId;
-  }
-  return _nextPacketId;
-}
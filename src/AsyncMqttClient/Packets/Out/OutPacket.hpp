@@ -13,6 +13,10 @@ class OutPacket {
   virtual ~OutPacket();
   virtual const uint8_t* data(size_t index = 0) const = 0;
   virtual size_t size() const = 0;
+  virtual size_t available(size_t index) const;  // contiguous bytes starting at index
+  virtual bool ownsData(size_t index) const;     // false if the bytes at index belong to the caller
+  virtual size_t pull(size_t index, size_t maxLength);  // make the bytes at index ready, returns how many can be sent
+  virtual bool persistent() const;  // journaled to the session store
   bool released() const;
   uint8_t packetType() const;
   uint16_t packetId() const;
@@ -21,15 +25,13 @@ class OutPacket {
 
  public:
   OutPacket* next;
-  uint32_t timeout;
-  uint8_t noTries;
+  uint32_t sequence;  // enqueue order, to keep FIFO order across the transmit lanes
+  uint32_t timeout;     // retransmission deadline, 0 if no timer is armed
+  uint8_t noTries;      // transmissions of an in-flight packet
+  OutPacket* nextTimer;  // in the same retransmission wheel slot
 
  protected:
-  static uint16_t _getNextPacketId();
   bool _released;
   uint16_t _packetId;
-
- private:
-  static uint16_t _nextPacketId;
 };
 }  // namespace AsyncMqttClientInternals
@@ -2,6 +2,8 @@
 
 using AsyncMqttClientInternals::PingReqOutPacket;
 
+static AsyncMqttClientInternals::Pool<sizeof(PingReqOutPacket), MQTT_POOL_CONTROL_PACKETS> pool;
+
 PingReqOutPacket::PingReqOutPacket() {
   _data[0] = AsyncMqttClientInternals::PacketType.PINGREQ;
   _data[0] = _data[0] << 4;
@@ -16,3 +18,15 @@ const uint8_t* PingReqOutPacket::data(size_t index) const {
 size_t PingReqOutPacket::size() const {
   return 2;
 }
+
+void* PingReqOutPacket::operator new(size_t size) {
+  return pool.allocate(size);
+}
+
+void PingReqOutPacket::operator delete(void* p) {
+  pool.deallocate(p);
+}
+
+AsyncMqttClientPoolUsage PingReqOutPacket::poolUsage() {
+  return pool.usage();
+}
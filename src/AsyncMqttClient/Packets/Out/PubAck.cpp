@@ -2,6 +2,8 @@
 
 using AsyncMqttClientInternals::PubAckOutPacket;
 
+static AsyncMqttClientInternals::Pool<sizeof(PubAckOutPacket), MQTT_POOL_ACK_PACKETS> pool;
+
 PubAckOutPacket::PubAckOutPacket(PendingAck pendingAck) {
   _data[0] = pendingAck.packetType;
   _data[0] = _data[0] << 4;
@@ -10,8 +12,7 @@ PubAckOutPacket::PubAckOutPacket(PendingAck pendingAck) {
   _packetId = pendingAck.packetId;
   _data[2] = pendingAck.packetId >> 8;
   _data[3] = pendingAck.packetId & 0xFF;
-  if (packetType() == AsyncMqttClientInternals::PacketType.PUBREL ||
-      packetType() == AsyncMqttClientInternals::PacketType.PUBREC) {
+  if (packetType() == AsyncMqttClientInternals::PacketType.PUBREL) {
     _released = false;
   }
 }
@@ -23,3 +24,15 @@ const uint8_t* PubAckOutPacket::data(size_t index) const {
 size_t PubAckOutPacket::size() const {
   return 4;
 }
+
+void* PubAckOutPacket::operator new(size_t size) {
+  return pool.allocate(size);
+}
+
+void PubAckOutPacket::operator delete(void* p) {
+  pool.deallocate(p);
+}
+
+AsyncMqttClientPoolUsage PubAckOutPacket::poolUsage() {
+  return pool.usage();
+}
@@ -3,6 +3,7 @@
 #include "OutPacket.hpp"
 #include "../../Flags.hpp"
 #include "../../Helpers.hpp"
+#include "../../Pool.hpp"
 #include "../../Storage.hpp"
 
 namespace AsyncMqttClientInternals {
@@ -12,6 +13,10 @@ class PubAckOutPacket : public OutPacket {
   const uint8_t* data(size_t index = 0) const;
   size_t size() const;
 
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+  static AsyncMqttClientPoolUsage poolUsage();
+
  private:
   uint8_t _data[4];
 };
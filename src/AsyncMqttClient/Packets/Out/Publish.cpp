@@ -1,8 +1,102 @@
 #include "Publish.hpp"
 
 using AsyncMqttClientInternals::PublishOutPacket;
+using AsyncMqttClientInternals::PublishBufferAllocator;
 
-PublishOutPacket::PublishOutPacket(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length) {
+static AsyncMqttClientInternals::Pool<sizeof(PublishOutPacket), MQTT_POOL_PUBLISH_PACKETS> pool;
+static AsyncMqttClientInternals::Pool<MQTT_ARENA_SLOT_SIZE, MQTT_ARENA_SLOTS> arena;
+
+uint8_t* PublishBufferAllocator::allocate(size_t n) {
+  return static_cast<uint8_t*>(arena.allocate(n));
+}
+
+void PublishBufferAllocator::deallocate(uint8_t* p, size_t n) {
+  (void)n;
+  arena.deallocate(p);
+}
+
+AsyncMqttClientPoolUsage PublishBufferAllocator::poolUsage() {
+  return arena.usage();
+}
+
+PublishOutPacket::PublishOutPacket(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length, uint16_t packetId)
+: _data()
+, _payload(nullptr)
+, _payloadLength(0)
+, _properties(false)
+, _onRelease() {
+  uint32_t payloadLength = length;
+  if (payload != nullptr && payloadLength == 0) payloadLength = strlen(payload);
+
+  _serializeHeader(topic, qos, retain, packetId, payloadLength, (payload != nullptr) ? payloadLength : 0);
+  if (payload != nullptr) _data.insert(_data.end(), payload, payload + payloadLength);
+}
+
+PublishOutPacket::PublishOutPacket(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length, OnPayloadReleaseUserCallback onRelease, uint16_t packetId)
+: _data()
+, _payload(payload)
+, _payloadLength((payload != nullptr) ? length : 0)
+, _properties(false)
+, _onRelease(onRelease) {
+  _serializeHeader(topic, qos, retain, packetId, _payloadLength, 0);
+}
+
+PublishOutPacket::PublishOutPacket(const char* topic, uint8_t qos, bool retain, size_t length, uint16_t packetId)
+: _data()
+, _payload(nullptr)
+, _payloadLength(length)
+, _properties(false)
+, _onRelease() {
+  _serializeHeader(topic, qos, retain, packetId, _payloadLength, 0);
+}
+
+PublishOutPacket::PublishOutPacket(const uint8_t* packet, size_t length, bool properties)
+: _data(packet, packet + length)
+, _payload(nullptr)
+, _payloadLength(0)
+, _properties(properties)
+, _onRelease() {
+  size_t index = 1;
+  while (index < length && (packet[index] & 0x80)) index++;  // remaining length
+  index++;
+  size_t topicLength = packet[index] << 8 | packet[index + 1];
+  index += 2 + topicLength;
+  if (qos() != 0) {
+    _packetId = packet[index] << 8 | packet[index + 1];
+    _released = false;
+  } else {
+    _packetId = 1;
+  }
+}
+
+bool PublishOutPacket::valid(const uint8_t* packet, size_t length, bool properties) {
+  if (length < 2 || (packet[0] >> 4) != AsyncMqttClientInternals::PacketType.PUBLISH) return false;
+  uint8_t qos = (packet[0] & 0x06) >> 1;
+  if (qos == 0 || qos == 3) return false;
+  size_t index = 1;
+  uint32_t remainingLength = 0;
+  uint32_t multiplier = 1;
+  do {
+    if (index >= length || index > 4) return false;
+    remainingLength += (packet[index] & 0x7F) * multiplier;
+    multiplier *= 128;
+  } while (packet[index++] & 0x80);
+  if (remainingLength != length - index) return false;  // truncated, or trailing bytes
+  if (index + 2 > length) return false;
+  size_t topicLength = packet[index] << 8 | packet[index + 1];
+  index += 2 + topicLength;
+  if (index + 2 > length) return false;
+  if ((packet[index] << 8 | packet[index + 1]) == 0) return false;  // packet ID
+  index += 2;
+  if (properties && (index >= length || (packet[index] & 0x80) || index + 1 + packet[index] > length)) return false;  // the client writes less than 128 bytes of properties
+  return true;
+}
+
+PublishOutPacket::~PublishOutPacket() {
+  if (_onRelease) _onRelease(_payload, _payloadLength);
+}
+
+void PublishOutPacket::_serializeHeader(const char* topic, uint8_t qos, bool retain, uint16_t packetId, uint32_t payloadLength, size_t reserve) {
   char fixedHeader[5];
   fixedHeader[0] = AsyncMqttClientInternals::PacketType.PUBLISH;
   fixedHeader[0] = fixedHeader[0] << 4;
@@ -25,9 +119,6 @@ PublishOutPacket::PublishOutPacket(const char* topic, uint8_t qos, bool retain,
   topicLengthBytes[0] = topicLength >> 8;
   topicLengthBytes[1] = topicLength & 0xFF;
 
-  uint32_t payloadLength = length;
-  if (payload != nullptr && payloadLength == 0) payloadLength = strlen(payload);
-
   uint32_t remainingLength = 2 + topicLength + payloadLength;
   if (qos != 0) remainingLength += 2;
   uint8_t remainingLengthLength = AsyncMqttClientInternals::Helpers::encodeRemainingLength(remainingLength, fixedHeader + 1);
@@ -37,11 +128,12 @@ PublishOutPacket::PublishOutPacket(const char* topic, uint8_t qos, bool retain,
   neededSpace += 2;
   neededSpace += topicLength;
   if (qos != 0) neededSpace += 2;
-  if (payload != nullptr) neededSpace += payloadLength;
+  neededSpace += reserve;
+  neededSpace += 5;  // room to add an MQTT 5.0 property section with a topic alias, and a longer remaining length
 
   _data.reserve(neededSpace);
 
-  _packetId = (qos !=0) ? _getNextPacketId() : 1;
+  _packetId = (qos !=0) ? packetId : 1;
   char packetIdBytes[2];
   packetIdBytes[0] = _packetId >> 8;
   packetIdBytes[1] = _packetId & 0xFF;
@@ -53,17 +145,101 @@ PublishOutPacket::PublishOutPacket(const char* topic, uint8_t qos, bool retain,
     _data.insert(_data.end(), packetIdBytes, packetIdBytes + 2);
     _released = false;
   }
-  if (payload != nullptr) _data.insert(_data.end(), payload, payload + payloadLength);
 }
 
 const uint8_t* PublishOutPacket::data(size_t index) const {
+  if (index >= _data.size()) return reinterpret_cast<const uint8_t*>(&_payload[index - _data.size()]);
   return &_data.data()[index];
 }
 
 size_t PublishOutPacket::size() const {
-  return _data.size();
+  return _data.size() + _payloadLength;
+}
+
+size_t PublishOutPacket::available(size_t index) const {
+  if (index >= _data.size()) return size() - index;
+  return _data.size() - index;
+}
+
+bool PublishOutPacket::ownsData(size_t index) const {
+  return index < _data.size();
+}
+
+bool PublishOutPacket::persistent() const {
+  return qos() != 0;
 }
 
 void PublishOutPacket::setDup() {
   _data[0] |= AsyncMqttClientInternals::HeaderFlag.PUBLISH_DUP;
 }
+
+void PublishOutPacket::setProperties(uint16_t topicAlias, bool withTopic) {
+  size_t index = 1;
+  while (_data[index] & 0x80) index++;
+  size_t variableHeader = ++index;  // after the remaining length
+  uint32_t remainingLength = size() - variableHeader;
+
+  size_t topicLength = _data[index] << 8 | _data[index + 1];
+  index += 2;
+  if (!withTopic) {
+    _data.erase(_data.begin() + index, _data.begin() + index + topicLength);
+    remainingLength -= topicLength;
+    _data[index - 2] = 0;
+    _data[index - 1] = 0;
+  } else {
+    index += topicLength;
+  }
+  if (qos() != 0) index += 2;
+
+  if (_properties) {
+    size_t propertiesLength = 1 + _data[index];  // the client writes less than 128 bytes of properties
+    _data.erase(_data.begin() + index, _data.begin() + index + propertiesLength);
+    remainingLength -= propertiesLength;
+  }
+  uint8_t properties[4];
+  size_t propertiesLength = 1;
+  properties[0] = 0;
+  if (topicAlias != 0) {
+    properties[0] = 3;
+    properties[1] = AsyncMqttClientInternals::Property.TOPIC_ALIAS;
+    properties[2] = topicAlias >> 8;
+    properties[3] = topicAlias & 0xFF;
+    propertiesLength = 4;
+  }
+  _data.insert(_data.begin() + index, properties, properties + propertiesLength);
+  remainingLength += propertiesLength;
+  _properties = true;
+
+  char remainingLengthBytes[4];
+  uint8_t remainingLengthLength = AsyncMqttClientInternals::Helpers::encodeRemainingLength(remainingLength, remainingLengthBytes);
+  if (remainingLengthLength != variableHeader - 1) {
+    _data.erase(_data.begin() + 1, _data.begin() + variableHeader);
+    _data.insert(_data.begin() + 1, remainingLengthBytes, remainingLengthBytes + remainingLengthLength);
+  } else {
+    std::copy(remainingLengthBytes, remainingLengthBytes + remainingLengthLength, _data.begin() + 1);
+  }
+}
+
+bool PublishOutPacket::hasProperties() const {
+  return _properties;
+}
+
+const char* PublishOutPacket::topic(size_t* length) const {
+  size_t index = 1;
+  while (_data[index] & 0x80) index++;
+  index++;
+  *length = _data[index] << 8 | _data[index + 1];
+  return reinterpret_cast<const char*>(&_data[index + 2]);
+}
+
+void* PublishOutPacket::operator new(size_t size) {
+  return pool.allocate(size);
+}
+
+void PublishOutPacket::operator delete(void* p) {
+  pool.deallocate(p);
+}
+
+AsyncMqttClientPoolUsage PublishOutPacket::poolUsage() {
+  return pool.usage();
+}
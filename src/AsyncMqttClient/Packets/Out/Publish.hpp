@@ -7,17 +7,66 @@
 #include "../../Flags.hpp"
 #include "../../Helpers.hpp"
 #include "../../Storage.hpp"
+#include "../../Callbacks.hpp"
+#include "../../Pool.hpp"
 
 namespace AsyncMqttClientInternals {
+// Allocates the serialized packet from the publish buffer arena
+class PublishBufferAllocator {
+ public:
+  typedef uint8_t value_type;
+  template <class U> struct rebind {
+    typedef PublishBufferAllocator other;
+  };
+
+  uint8_t* allocate(size_t n);
+  void deallocate(uint8_t* p, size_t n);
+  bool operator==(const PublishBufferAllocator&) const { return true; }
+  bool operator!=(const PublishBufferAllocator&) const { return false; }
+  static AsyncMqttClientPoolUsage poolUsage();
+};
+
 class PublishOutPacket : public OutPacket {
  public:
-  PublishOutPacket(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length);
+  // packetId is only used for QoS 1 and 2
+  PublishOutPacket(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length, uint16_t packetId);
+  PublishOutPacket(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length, OnPayloadReleaseUserCallback onRelease, uint16_t packetId);
+  PublishOutPacket(const uint8_t* packet, size_t length, bool properties);  // restore a serialized packet, checked by valid() first
+  ~PublishOutPacket();
   const uint8_t* data(size_t index = 0) const;
   size_t size() const;
+  size_t available(size_t index) const;
+  bool ownsData(size_t index) const;
+  bool persistent() const;
 
   void setDup();  // you cannot unset dup
 
+  // MQTT 5.0: add the (empty) property section, or replace it with one holding a topic alias,
+  // with or without the topic. Only before the packet is sent.
+  void setProperties(uint16_t topicAlias = 0, bool withTopic = true);
+  bool hasProperties() const;
+  const char* topic(size_t* length) const;
+
+  // whether a journaled packet is a whole QoS 1 or 2 PUBLISH, so that it can be restored
+  static bool valid(const uint8_t* packet, size_t length, bool properties);
+
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+  static AsyncMqttClientPoolUsage poolUsage();
+
+ protected:
+  PublishOutPacket(const char* topic, uint8_t qos, bool retain, size_t length, uint16_t packetId);  // header only, the payload is supplied by a subclass
+
+ private:
+  void _serializeHeader(const char* topic, uint8_t qos, bool retain, uint16_t packetId, uint32_t payloadLength, size_t reserve);
+
+ protected:
+  std::vector<uint8_t, PublishBufferAllocator> _data;  // fixed header, topic and packet ID, plus the payload unless it is caller-owned
+  const char* _payload;        // caller-owned payload, not copied
+  size_t _payloadLength;
+  bool _properties;            // MQTT 5.0 property section present
+
  private:
-  std::vector<uint8_t> _data;
+  OnPayloadReleaseUserCallback _onRelease;
 };
 }  // namespace AsyncMqttClientInternals
@@ -0,0 +1,57 @@
+#include "PublishStream.hpp"
+
+using AsyncMqttClientInternals::PublishStreamOutPacket;
+
+PublishStreamOutPacket::PublishStreamOutPacket(const char* topic, uint8_t qos, bool retain, size_t length, OnPayloadChunkUserCallback producer, uint16_t packetId)
+: PublishOutPacket(topic, qos, retain, length, packetId)
+, _producer(producer)
+, _chunk(nullptr)
+, _chunkIndex(0)
+, _chunkLength(0) {
+}
+
+PublishStreamOutPacket::~PublishStreamOutPacket() {
+  delete[] _chunk;
+}
+
+const uint8_t* PublishStreamOutPacket::data(size_t index) const {
+  if (index < _data.size()) return &_data.data()[index];
+  return &_chunk[index - _chunkIndex];
+}
+
+size_t PublishStreamOutPacket::available(size_t index) const {
+  if (index < _data.size()) return _data.size() - index;
+  if (index < _chunkIndex || index >= _chunkIndex + _chunkLength) return 0;
+  return _chunkIndex + _chunkLength - index;
+}
+
+bool PublishStreamOutPacket::ownsData(size_t index) const {
+  (void)index;
+  return true;  // the chunk buffer is reused, TCP has to copy it
+}
+
+bool PublishStreamOutPacket::persistent() const {
+  return false;  // the payload is not in memory
+}
+
+size_t PublishStreamOutPacket::pull(size_t index, size_t maxLength) {
+  size_t ready = available(index);
+  if (ready == 0 && index < size()) {
+    // The chunk is used up, or the packet is resent from the start: ask the producer
+    if (!_chunk) _chunk = new uint8_t[MQTT_STREAM_CHUNK_SIZE];
+    size_t offset = index - _data.size();
+    size_t wanted = std::min(std::min(maxLength, static_cast<size_t>(MQTT_STREAM_CHUNK_SIZE)), _payloadLength - offset);
+    _chunkIndex = index;
+    _chunkLength = std::min(_producer(_chunk, wanted, offset), wanted);
+    ready = _chunkLength;
+  }
+  return std::min(ready, maxLength);
+}
+
+void* PublishStreamOutPacket::operator new(size_t size) {
+  return ::operator new(size);  // too big for the PUBLISH pool
+}
+
+void PublishStreamOutPacket::operator delete(void* p) {
+  ::operator delete(p);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Publish.hpp"
+
+// Payload bytes pulled from the producer at once
+#ifndef MQTT_STREAM_CHUNK_SIZE
+#define MQTT_STREAM_CHUNK_SIZE 512
+#endif
+
+namespace AsyncMqttClientInternals {
+// PUBLISH with a payload pulled from the caller chunk by chunk while it is sent
+class PublishStreamOutPacket : public PublishOutPacket {
+ public:
+  PublishStreamOutPacket(const char* topic, uint8_t qos, bool retain, size_t length, OnPayloadChunkUserCallback producer, uint16_t packetId);
+  ~PublishStreamOutPacket();
+  const uint8_t* data(size_t index = 0) const;
+  size_t available(size_t index) const;
+  bool ownsData(size_t index) const;
+  bool persistent() const;
+  size_t pull(size_t index, size_t maxLength);
+
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+
+ private:
+  OnPayloadChunkUserCallback _producer;
+  uint8_t* _chunk;     // allocated on the first pull
+  size_t _chunkIndex;  // packet index of the first byte in _chunk
+  size_t _chunkLength;
+};
+}  // namespace AsyncMqttClientInternals
@@ -2,41 +2,40 @@
 
 using AsyncMqttClientInternals::SubscribeOutPacket;
 
-SubscribeOutPacket::SubscribeOutPacket(const char* topic, uint8_t qos) {
+SubscribeOutPacket::SubscribeOutPacket(const AsyncMqttClientSubscription* subscriptions, size_t count, uint16_t packetId, bool properties) {
   char fixedHeader[5];
   fixedHeader[0] = AsyncMqttClientInternals::PacketType.SUBSCRIBE;
   fixedHeader[0] = fixedHeader[0] << 4;
   fixedHeader[0] = fixedHeader[0] | AsyncMqttClientInternals::HeaderFlag.SUBSCRIBE_RESERVED;
 
-  uint16_t topicLength = strlen(topic);
-  char topicLengthBytes[2];
-  topicLengthBytes[0] = topicLength >> 8;
-  topicLengthBytes[1] = topicLength & 0xFF;
+  // packet ID and properties, then topic length, topic and requested QoS for each filter
+  uint32_t remainingLength = properties ? 3 : 2;
+  for (size_t i = 0; i < count; i++) remainingLength += 2 + strlen(subscriptions[i].topic) + 1;
 
-  char qosByte[1];
-  qosByte[0] = qos;
+  uint8_t remainingLengthLength = AsyncMqttClientInternals::Helpers::encodeRemainingLength(remainingLength, fixedHeader + 1);
 
-  uint8_t remainingLengthLength = AsyncMqttClientInternals::Helpers::encodeRemainingLength(2 + 2 + topicLength + 1, fixedHeader + 1);
+  _data.reserve(1 + remainingLengthLength + remainingLength);
 
-  size_t neededSpace = 0;
-  neededSpace += 1 + remainingLengthLength;
-  neededSpace += 2;
-  neededSpace += 2;
-  neededSpace += topicLength;
-  neededSpace += 1;
-
-  _data.reserve(neededSpace);
-
-  _packetId = _getNextPacketId();
+  _packetId = packetId;
   char packetIdBytes[2];
   packetIdBytes[0] = _packetId >> 8;
   packetIdBytes[1] = _packetId & 0xFF;
 
   _data.insert(_data.end(), fixedHeader, fixedHeader + 1 + remainingLengthLength);
   _data.insert(_data.end(), packetIdBytes, packetIdBytes + 2);
-  _data.insert(_data.end(), topicLengthBytes, topicLengthBytes + 2);
-  _data.insert(_data.end(), topic, topic + topicLength);
-  _data.push_back(qosByte[0]);
+  if (properties) _data.push_back(0);
+  for (size_t i = 0; i < count; i++) {
+    const char* topic = subscriptions[i].topic;
+    uint16_t topicLength = strlen(topic);
+    char topicLengthBytes[2];
+    topicLengthBytes[0] = topicLength >> 8;
+    topicLengthBytes[1] = topicLength & 0xFF;
+
+    _data.insert(_data.end(), topicLengthBytes, topicLengthBytes + 2);
+    _data.insert(_data.end(), topic, topic + topicLength);
+    _data.push_back(subscriptions[i].qos);
+  }
+  _properties = properties;
   _released = false;
 }
 
@@ -7,15 +7,31 @@
 #include "../../Flags.hpp"
 #include "../../Helpers.hpp"
 #include "../../Storage.hpp"
+#include "../../Subscription.hpp"
 
 namespace AsyncMqttClientInternals {
 class SubscribeOutPacket : public OutPacket {
  public:
-  SubscribeOutPacket(const char* topic, uint8_t qos);
+  // properties: MQTT 5.0, with an empty property section
+  SubscribeOutPacket(const AsyncMqttClientSubscription* subscriptions, size_t count, uint16_t packetId, bool properties);
   const uint8_t* data(size_t index = 0) const;
   size_t size() const;
 
+  // calls visit(topic, topicLength, qos) for each filter, in the order of the packet
+  template <typename Visitor>
+  void forEachFilter(Visitor visit) const {
+    size_t index = 1;
+    while (_data[index++] & 0x80) {}  // remaining length
+    index += _properties ? 3 : 2;     // packet ID and properties
+    while (index < _data.size()) {
+      size_t topicLength = _data[index] << 8 | _data[index + 1];
+      visit(reinterpret_cast<const char*>(&_data[index + 2]), topicLength, _data[index + 2 + topicLength]);
+      index += 2 + topicLength + 1;
+    }
+  }
+
  private:
   std::vector<uint8_t> _data;
+  bool _properties;
 };
 }  // namespace AsyncMqttClientInternals
@@ -2,34 +2,37 @@
 
 using AsyncMqttClientInternals::UnsubscribeOutPacket;
 
-UnsubscribeOutPacket::UnsubscribeOutPacket(const char* topic) {
+UnsubscribeOutPacket::UnsubscribeOutPacket(const char* const* topics, size_t count, uint16_t packetId, bool properties) {
   char fixedHeader[5];
   fixedHeader[0] = AsyncMqttClientInternals::PacketType.UNSUBSCRIBE;
   fixedHeader[0] = fixedHeader[0] << 4;
   fixedHeader[0] = fixedHeader[0] | AsyncMqttClientInternals::HeaderFlag.UNSUBSCRIBE_RESERVED;
 
-  uint16_t topicLength = strlen(topic);
-  char topicLengthBytes[2];
-  topicLengthBytes[0] = topicLength >> 8;
-  topicLengthBytes[1] = topicLength & 0xFF;
+  // packet ID and properties, then topic length and topic for each filter
+  uint32_t remainingLength = properties ? 3 : 2;
+  for (size_t i = 0; i < count; i++) remainingLength += 2 + strlen(topics[i]);
 
-  uint8_t remainingLengthLength = AsyncMqttClientInternals::Helpers::encodeRemainingLength(2 + 2 + topicLength, fixedHeader + 1);
+  uint8_t remainingLengthLength = AsyncMqttClientInternals::Helpers::encodeRemainingLength(remainingLength, fixedHeader + 1);
 
-  size_t neededSpace = 0;
-  neededSpace += 1 + remainingLengthLength;
-  neededSpace += 2;
-  neededSpace += 2;
-  neededSpace += topicLength;
+  _data.reserve(1 + remainingLengthLength + remainingLength);
 
-  _packetId = _getNextPacketId();
+  _packetId = packetId;
   char packetIdBytes[2];
   packetIdBytes[0] = _packetId >> 8;
   packetIdBytes[1] = _packetId & 0xFF;
 
   _data.insert(_data.end(), fixedHeader, fixedHeader + 1 + remainingLengthLength);
   _data.insert(_data.end(), packetIdBytes, packetIdBytes + 2);
-  _data.insert(_data.end(), topicLengthBytes, topicLengthBytes + 2);
-  _data.insert(_data.end(), topic, topic + topicLength);
+  if (properties) _data.push_back(0);
+  for (size_t i = 0; i < count; i++) {
+    uint16_t topicLength = strlen(topics[i]);
+    char topicLengthBytes[2];
+    topicLengthBytes[0] = topicLength >> 8;
+    topicLengthBytes[1] = topicLength & 0xFF;
+
+    _data.insert(_data.end(), topicLengthBytes, topicLengthBytes + 2);
+    _data.insert(_data.end(), topics[i], topics[i] + topicLength);
+  }
   _released = false;
 }
 
@@ -11,7 +11,8 @@
 namespace AsyncMqttClientInternals {
 class UnsubscribeOutPacket : public OutPacket {
  public:
-  explicit UnsubscribeOutPacket(const char* topic);
+  // properties: MQTT 5.0, with an empty property section
+  UnsubscribeOutPacket(const char* const* topics, size_t count, uint16_t packetId, bool properties);
   const uint8_t* data(size_t index = 0) const;
   size_t size() const;
 
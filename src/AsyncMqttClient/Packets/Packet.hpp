@@ -1,5 +1,7 @@
 #pragma once
 
+class AsyncMqttClient;
+
 namespace AsyncMqttClientInternals {
 class Packet {
  public:
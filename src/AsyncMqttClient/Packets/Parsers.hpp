@@ -0,0 +1,34 @@
+#pragma once
+
+#include <new>  // placement new
+
+#include "ConnAckPacket.hpp"
+#include "PingRespPacket.hpp"
+#include "SubAckPacket.hpp"
+#include "UnsubAckPacket.hpp"
+#include "PublishPacket.hpp"
+#include "PubRelPacket.hpp"
+#include "PubAckPacket.hpp"
+#include "PubRecPacket.hpp"
+#include "PubCompPacket.hpp"
+#include "DisconnectPacket.hpp"
+
+namespace AsyncMqttClientInternals {
+// Room for the parser of the packet being received. The client constructs it
+// in place and destroys it once the packet is handled, the heap is not used.
+union ParserStorage {
+  ParserStorage() {}
+  ~ParserStorage() {}
+
+  ConnAckPacket connAck;
+  PingRespPacket pingResp;
+  SubAckPacket subAck;
+  UnsubAckPacket unsubAck;
+  PublishPacket publish;
+  PubRelPacket pubRel;
+  PubAckPacket pubAck;
+  PubRecPacket pubRec;
+  PubCompPacket pubComp;
+  DisconnectPacket disconnect;
+};
+}  // namespace AsyncMqttClientInternals
@@ -1,10 +1,11 @@
 #include "PingRespPacket.hpp"
+#include "../../AsyncMqttClient.hpp"
 
 using AsyncMqttClientInternals::PingRespPacket;
 
-PingRespPacket::PingRespPacket(ParsingInformation* parsingInformation, OnPingRespInternalCallback callback)
+PingRespPacket::PingRespPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client)
 : _parsingInformation(parsingInformation)
-, _callback(callback) {
+, _client(client) {
 }
 
 PingRespPacket::~PingRespPacket() {
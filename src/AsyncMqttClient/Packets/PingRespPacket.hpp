@@ -3,12 +3,11 @@
 #include "Arduino.h"
 #include "Packet.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
 
 namespace AsyncMqttClientInternals {
 class PingRespPacket : public Packet {
  public:
-  explicit PingRespPacket(ParsingInformation* parsingInformation, OnPingRespInternalCallback callback);
+  explicit PingRespPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~PingRespPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -16,6 +15,6 @@ class PingRespPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnPingRespInternalCallback _callback;
+  AsyncMqttClient* _client;
 };
 }  // namespace AsyncMqttClientInternals
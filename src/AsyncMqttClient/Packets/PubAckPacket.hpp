@@ -3,12 +3,11 @@
 #include "Arduino.h"
 #include "Packet.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
 
 namespace AsyncMqttClientInternals {
 class PubAckPacket : public Packet {
  public:
-  explicit PubAckPacket(ParsingInformation* parsingInformation, OnPubAckInternalCallback callback);
+  explicit PubAckPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~PubAckPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -16,9 +15,9 @@ class PubAckPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnPubAckInternalCallback _callback;
+  AsyncMqttClient* _client;
 
-  uint8_t _bytePosition;
+  uint32_t _bytePosition;
   char _packetIdMsb;
   uint16_t _packetId;
 };
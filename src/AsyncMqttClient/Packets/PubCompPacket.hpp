@@ -3,12 +3,11 @@
 #include "Arduino.h"
 #include "Packet.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
 
 namespace AsyncMqttClientInternals {
 class PubCompPacket : public Packet {
  public:
-  explicit PubCompPacket(ParsingInformation* parsingInformation, OnPubCompInternalCallback callback);
+  explicit PubCompPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~PubCompPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -16,9 +15,9 @@ class PubCompPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnPubCompInternalCallback _callback;
+  AsyncMqttClient* _client;
 
-  uint8_t _bytePosition;
+  uint32_t _bytePosition;
   char _packetIdMsb;
   uint16_t _packetId;
 };
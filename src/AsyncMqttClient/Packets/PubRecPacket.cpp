@@ -1,13 +1,17 @@
 #include "PubRecPacket.hpp"
+#include "../../AsyncMqttClient.hpp"
+
+#include <algorithm>  // std::min
 
 using AsyncMqttClientInternals::PubRecPacket;
 
-PubRecPacket::PubRecPacket(ParsingInformation* parsingInformation, OnPubRecInternalCallback callback)
+PubRecPacket::PubRecPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client)
 : _parsingInformation(parsingInformation)
-, _callback(callback)
+, _client(client)
 , _bytePosition(0)
 , _packetIdMsb(0)
-, _packetId(0) {
+, _packetId(0)
+, _reasonCode(0) {
 }
 
 PubRecPacket::~PubRecPacket() {
@@ -19,12 +23,22 @@ void PubRecPacket::parseVariableHeader(char* data, size_t len, size_t* currentBy
     _packetIdMsb = currentByte;
   } else {
     _packetId = currentByte | _packetIdMsb << 8;
-    _parsingInformation->bufferState = BufferState::NONE;
-    _callback(_packetId);
+    if (_parsingInformation->remainingLength > 2) {
+      _parsingInformation->bufferState = BufferState::PAYLOAD;  // MQTT 5.0 reason code and properties
+    } else {
+      _parsingInformation->bufferState = BufferState::NONE;
+      _client->_onPubRec(_packetId, 0);
+    }
   }
 }
 
 void PubRecPacket::parsePayload(char* data, size_t len, size_t* currentBytePosition) {
-  (void)data;
-  (void)currentBytePosition;
+  // the MQTT 5.0 reason code is kept, the properties are skipped
+  if (_bytePosition == 2) _reasonCode = data[*currentBytePosition];
+  size_t chunk = std::min<size_t>(_parsingInformation->remainingLength - _bytePosition, len - (*currentBytePosition));
+  (*currentBytePosition) += chunk;
+  _bytePosition += chunk;
+  if (_bytePosition < _parsingInformation->remainingLength) return;
+  _parsingInformation->bufferState = BufferState::NONE;
+  _client->_onPubRec(_packetId, _reasonCode);
 }
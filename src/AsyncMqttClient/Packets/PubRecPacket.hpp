@@ -3,12 +3,11 @@
 #include "Arduino.h"
 #include "Packet.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
 
 namespace AsyncMqttClientInternals {
 class PubRecPacket : public Packet {
  public:
-  explicit PubRecPacket(ParsingInformation* parsingInformation, OnPubRecInternalCallback callback);
+  explicit PubRecPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~PubRecPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -16,10 +15,11 @@ class PubRecPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnPubRecInternalCallback _callback;
+  AsyncMqttClient* _client;
 
-  uint8_t _bytePosition;
+  uint32_t _bytePosition;
   char _packetIdMsb;
   uint16_t _packetId;
+  uint8_t _reasonCode;
 };
 }  // namespace AsyncMqttClientInternals
@@ -1,10 +1,13 @@
 #include "PubRelPacket.hpp"
+#include "../../AsyncMqttClient.hpp"
+
+#include <algorithm>  // std::min
 
 using AsyncMqttClientInternals::PubRelPacket;
 
-PubRelPacket::PubRelPacket(ParsingInformation* parsingInformation, OnPubRelInternalCallback callback)
+PubRelPacket::PubRelPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client)
 : _parsingInformation(parsingInformation)
-, _callback(callback)
+, _client(client)
 , _bytePosition(0)
 , _packetIdMsb(0)
 , _packetId(0) {
@@ -19,12 +22,21 @@ void PubRelPacket::parseVariableHeader(char* data, size_t len, size_t* currentBy
     _packetIdMsb = currentByte;
   } else {
     _packetId = currentByte | _packetIdMsb << 8;
-    _parsingInformation->bufferState = BufferState::NONE;
-    _callback(_packetId);
+    if (_parsingInformation->remainingLength > 2) {
+      _parsingInformation->bufferState = BufferState::PAYLOAD;  // MQTT 5.0 reason code and properties
+    } else {
+      _parsingInformation->bufferState = BufferState::NONE;
+      _client->_onPubRel(_packetId);
+    }
   }
 }
 
 void PubRelPacket::parsePayload(char* data, size_t len, size_t* currentBytePosition) {
-  (void)data;
-  (void)currentBytePosition;
+  // the MQTT 5.0 reason code and properties are skipped
+  size_t chunk = std::min<size_t>(_parsingInformation->remainingLength - _bytePosition, len - (*currentBytePosition));
+  (*currentBytePosition) += chunk;
+  _bytePosition += chunk;
+  if (_bytePosition < _parsingInformation->remainingLength) return;
+  _parsingInformation->bufferState = BufferState::NONE;
+  _client->_onPubRel(_packetId);
 }
@@ -3,12 +3,11 @@
 #include "Arduino.h"
 #include "Packet.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
 
 namespace AsyncMqttClientInternals {
 class PubRelPacket : public Packet {
  public:
-  explicit PubRelPacket(ParsingInformation* parsingInformation, OnPubRelInternalCallback callback);
+  explicit PubRelPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~PubRelPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -16,9 +15,9 @@ class PubRelPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnPubRelInternalCallback _callback;
+  AsyncMqttClient* _client;
 
-  uint8_t _bytePosition;
+  uint32_t _bytePosition;
   char _packetIdMsb;
   uint16_t _packetId;
 };
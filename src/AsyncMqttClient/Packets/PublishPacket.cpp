@@ -1,11 +1,14 @@
 #include "PublishPacket.hpp"
+#include "../../AsyncMqttClient.hpp"
+
+#include <cstring>  // memcpy
+#include <algorithm>  // std::min
 
 using AsyncMqttClientInternals::PublishPacket;
 
-PublishPacket::PublishPacket(ParsingInformation* parsingInformation, OnMessageInternalCallback dataCallback, OnPublishInternalCallback completeCallback)
+PublishPacket::PublishPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client)
 : _parsingInformation(parsingInformation)
-, _dataCallback(dataCallback)
-, _completeCallback(completeCallback)
+, _client(client)
 , _dup(false)
 , _qos(0)
 , _retain(0)
@@ -15,6 +18,10 @@ PublishPacket::PublishPacket(ParsingInformation* parsingInformation, OnMessageIn
 , _ignore(false)
 , _packetIdMsb(0)
 , _packetId(0)
+, _inProperties(false)
+, _propertiesLength(0)
+, _propertiesShift(0)
+, _propertiesEnd(0)
 , _payloadLength(0)
 , _payloadBytesRead(0) {
     _dup = _parsingInformation->packetFlags & HeaderFlag.PUBLISH_DUP;
@@ -37,6 +44,36 @@ PublishPacket::~PublishPacket() {
 }
 
 void PublishPacket::parseVariableHeader(char* data, size_t len, size_t* currentBytePosition) {
+  if (_inProperties) {
+    if (_propertiesEnd == 0) {
+      // property length, then the properties which are skipped
+      char currentByte = data[(*currentBytePosition)++];
+      _propertiesLength |= static_cast<uint32_t>(currentByte & 0x7F) << _propertiesShift;
+      _propertiesShift += 7;
+      _bytePosition++;
+      if (currentByte & 0x80) return;
+      _propertiesEnd = _bytePosition + _propertiesLength;
+    }
+    size_t chunk = std::min<size_t>(_propertiesEnd - _bytePosition, len - (*currentBytePosition));
+    (*currentBytePosition) += chunk;
+    _bytePosition += chunk;
+    if (_bytePosition == _propertiesEnd) {
+      _inProperties = false;
+      _preparePayloadHandling(_parsingInformation->remainingLength - _bytePosition);
+    }
+    return;
+  }
+
+  if (_bytePosition >= 2 && _bytePosition < 2u + _topicLength) {
+    // copy as much of the topic as this segment holds at once
+    size_t chunk = std::min<size_t>(2u + _topicLength - _bytePosition, len - (*currentBytePosition));
+    if (!_ignore) memcpy(&_parsingInformation->topicBuffer[_bytePosition - 2], &data[*currentBytePosition], chunk);
+    (*currentBytePosition) += chunk;
+    _bytePosition += chunk;
+    if (_bytePosition == 2u + _topicLength && _qos == 0) _endOfHeader();
+    return;
+  }
+
   char currentByte = data[(*currentBytePosition)++];
   if (_bytePosition == 0) {
     _topicLengthMsb = currentByte;
@@ -47,29 +84,33 @@ void PublishPacket::parseVariableHeader(char* data, size_t len, size_t* currentB
     } else {
       _parsingInformation->topicBuffer[_topicLength] = '\0';
     }
-  } else if (_bytePosition >= 2 && _bytePosition < 2 + _topicLength) {
-    // Starting from here, _ignore might be true
-    if (!_ignore) _parsingInformation->topicBuffer[_bytePosition - 2] = currentByte;
-    if (_bytePosition == 2 + _topicLength - 1 && _qos == 0) {
-      _preparePayloadHandling(_parsingInformation->remainingLength - (_bytePosition + 1));
-      return;
-    }
-  } else if (_bytePosition == 2 + _topicLength) {
+  } else if (_bytePosition == 2u + _topicLength) {
     _packetIdMsb = currentByte;
   } else {
     _packetId = currentByte | _packetIdMsb << 8;
-    _preparePayloadHandling(_parsingInformation->remainingLength - (_bytePosition + 1));
+    _bytePosition++;
+    _endOfHeader();
+    return;
   }
   _bytePosition++;
 }
 
+void PublishPacket::_endOfHeader() {
+  if (_parsingInformation->protocolLevel == ProtocolLevel.MQTT_5_0) {
+    _inProperties = true;
+    _parsingInformation->bufferState = BufferState::VARIABLE_HEADER;
+  } else {
+    _preparePayloadHandling(_parsingInformation->remainingLength - _bytePosition);
+  }
+}
+
 void PublishPacket::_preparePayloadHandling(uint32_t payloadLength) {
   _payloadLength = payloadLength;
   if (payloadLength == 0) {
     _parsingInformation->bufferState = BufferState::NONE;
     if (!_ignore) {
-      _dataCallback(_parsingInformation->topicBuffer, nullptr, _qos, _dup, _retain, 0, 0, 0, _packetId);
-      _completeCallback(_packetId, _qos);
+      _client->_onMessage(_parsingInformation->topicBuffer, nullptr, _qos, _dup, _retain, 0, 0, 0, _packetId);
+      _client->_onPublish(_packetId, _qos);
     }
   } else {
     _parsingInformation->bufferState = BufferState::PAYLOAD;
@@ -80,12 +121,12 @@ void PublishPacket::parsePayload(char* data, size_t len, size_t* currentBytePosi
   size_t remainToRead = len - (*currentBytePosition);
   if (_payloadBytesRead + remainToRead > _payloadLength) remainToRead = _payloadLength - _payloadBytesRead;
 
-  if (!_ignore) _dataCallback(_parsingInformation->topicBuffer, data + (*currentBytePosition), _qos, _dup, _retain, remainToRead, _payloadBytesRead, _payloadLength, _packetId);
+  if (!_ignore) _client->_onMessage(_parsingInformation->topicBuffer, data + (*currentBytePosition), _qos, _dup, _retain, remainToRead, _payloadBytesRead, _payloadLength, _packetId);
   _payloadBytesRead += remainToRead;
   (*currentBytePosition) += remainToRead;
 
   if (_payloadBytesRead == _payloadLength) {
     _parsingInformation->bufferState = BufferState::NONE;
-    if (!_ignore) _completeCallback(_packetId, _qos);
+    if (!_ignore) _client->_onPublish(_packetId, _qos);
   }
 }
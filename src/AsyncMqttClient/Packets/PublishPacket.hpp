@@ -4,12 +4,11 @@
 #include "Packet.hpp"
 #include "../Flags.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
 
 namespace AsyncMqttClientInternals {
 class PublishPacket : public Packet {
  public:
-  explicit PublishPacket(ParsingInformation* parsingInformation, OnMessageInternalCallback dataCallback, OnPublishInternalCallback completeCallback);
+  explicit PublishPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~PublishPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -17,21 +16,25 @@ class PublishPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnMessageInternalCallback _dataCallback;
-  OnPublishInternalCallback _completeCallback;
+  AsyncMqttClient* _client;
 
+  void _endOfHeader();
   void _preparePayloadHandling(uint32_t payloadLength);
 
   bool _dup;
   uint8_t _qos;
   bool _retain;
 
-  uint8_t _bytePosition;
+  uint32_t _bytePosition;
   char _topicLengthMsb;
   uint16_t _topicLength;
   bool _ignore;
   char _packetIdMsb;
   uint16_t _packetId;
+  bool _inProperties;        // MQTT 5.0
+  uint32_t _propertiesLength;
+  uint8_t _propertiesShift;
+  uint32_t _propertiesEnd;   // 0 until the property length is read
   uint32_t _payloadLength;
   uint32_t _payloadBytesRead;
 };
@@ -1,13 +1,17 @@
 #include "SubAckPacket.hpp"
+#include "../../AsyncMqttClient.hpp"
 
 using AsyncMqttClientInternals::SubAckPacket;
 
-SubAckPacket::SubAckPacket(ParsingInformation* parsingInformation, OnSubAckInternalCallback callback)
+SubAckPacket::SubAckPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client)
 : _parsingInformation(parsingInformation)
-, _callback(callback)
+, _client(client)
 , _bytePosition(0)
 , _packetIdMsb(0)
-, _packetId(0) {
+, _packetId(0)
+, _codesStart((parsingInformation->protocolLevel == ProtocolLevel.MQTT_5_0) ? 0 : 2)
+, _propertiesLength(0)
+, _propertiesShift(0) {
 }
 
 SubAckPacket::~SubAckPacket() {
@@ -24,7 +28,17 @@ void SubAckPacket::parseVariableHeader(char* data, size_t len, size_t* currentBy
 }
 
 void SubAckPacket::parsePayload(char* data, size_t len, size_t* currentBytePosition) {
+  // one return code per filter of the SUBSCRIBE, the codes beyond the batch limit are dropped.
+  // MQTT 5.0 puts properties before them, which are skipped.
   char status = data[(*currentBytePosition)++];
+  uint32_t position = _bytePosition++;
+  if (_codesStart == 0) {
+    _propertiesLength |= static_cast<uint32_t>(status & 0x7F) << _propertiesShift;
+    _propertiesShift += 7;
+    if ((status & 0x80) == 0) _codesStart = _bytePosition + _propertiesLength;
+  } else if (position >= _codesStart && position - _codesStart < MQTT_SUBSCRIBE_BATCH_MAX) {
+    _returnCodes[position - _codesStart] = status;
+  }
 
   /* switch (status) {
     case 0:
@@ -41,6 +55,8 @@ void SubAckPacket::parsePayload(char* data, size_t len, size_t* currentBytePosit
       break;
   } */
 
+  if (_bytePosition < _parsingInformation->remainingLength) return;
+  size_t count = (_codesStart > 0 && _bytePosition > _codesStart) ? _bytePosition - _codesStart : 0;
   _parsingInformation->bufferState = BufferState::NONE;
-  _callback(_packetId, status);
+  _client->_onSubAck(_packetId, _returnCodes, count < MQTT_SUBSCRIBE_BATCH_MAX ? count : MQTT_SUBSCRIBE_BATCH_MAX);
 }
@@ -2,13 +2,14 @@
 
 #include "Arduino.h"
 #include "Packet.hpp"
+#include "../Flags.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
+#include "../Subscription.hpp"
 
 namespace AsyncMqttClientInternals {
 class SubAckPacket : public Packet {
  public:
-  explicit SubAckPacket(ParsingInformation* parsingInformation, OnSubAckInternalCallback callback);
+  explicit SubAckPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~SubAckPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -16,10 +17,14 @@ class SubAckPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnSubAckInternalCallback _callback;
+  AsyncMqttClient* _client;
 
-  uint8_t _bytePosition;
+  uint32_t _bytePosition;
   char _packetIdMsb;
   uint16_t _packetId;
+  uint32_t _codesStart;  // MQTT 5.0: 0 until the property length is read
+  uint32_t _propertiesLength;
+  uint8_t _propertiesShift;
+  uint8_t _returnCodes[MQTT_SUBSCRIBE_BATCH_MAX];
 };
 }  // namespace AsyncMqttClientInternals
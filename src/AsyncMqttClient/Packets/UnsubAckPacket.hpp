@@ -3,12 +3,11 @@
 #include "Arduino.h"
 #include "Packet.hpp"
 #include "../ParsingInformation.hpp"
-#include "../Callbacks.hpp"
 
 namespace AsyncMqttClientInternals {
 class UnsubAckPacket : public Packet {
  public:
-  explicit UnsubAckPacket(ParsingInformation* parsingInformation, OnUnsubAckInternalCallback callback);
+  explicit UnsubAckPacket(ParsingInformation* parsingInformation, AsyncMqttClient* client);
   ~UnsubAckPacket();
 
   void parseVariableHeader(char* data, size_t len, size_t* currentBytePosition);
@@ -16,9 +15,9 @@ class UnsubAckPacket : public Packet {
 
  private:
   ParsingInformation* _parsingInformation;
-  OnUnsubAckInternalCallback _callback;
+  AsyncMqttClient* _client;
 
-  uint8_t _bytePosition;
+  uint32_t _bytePosition;
   char _packetIdMsb;
   uint16_t _packetId;
 };
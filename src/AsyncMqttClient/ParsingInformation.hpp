@@ -11,6 +11,7 @@ enum class BufferState : uint8_t {
 struct ParsingInformation {
   BufferState bufferState;
 
+  uint8_t protocolLevel;  // MQTT 5.0 packets carry properties
   uint16_t maxTopicLength;
   char* topicBuffer;
 
@@ -0,0 +1,5 @@
+#include "Pool.hpp"
+
+#if defined(ARDUINO_ARCH_ESP32)
+portMUX_TYPE AsyncMqttClientInternals::poolMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>  // uint*_t
+#include <stddef.h>  // size_t
+#include <new>       // ::operator new
+
+#include "Stats.hpp"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <freertos/FreeRTOS.h>
+#endif
+
+// Number of preallocated objects per pool, set to 0 to always use the heap
+#ifndef MQTT_POOL_ACK_PACKETS
+#define MQTT_POOL_ACK_PACKETS 8  // outgoing PUBACK, PUBREC, PUBREL and PUBCOMP
+#endif
+
+#ifndef MQTT_POOL_CONTROL_PACKETS
+#define MQTT_POOL_CONTROL_PACKETS 2  // outgoing PINGREQ and DISCONNECT, each
+#endif
+
+#ifndef MQTT_POOL_PUBLISH_PACKETS
+#define MQTT_POOL_PUBLISH_PACKETS 8  // outgoing PUBLISH
+#endif
+
+// Arena for the serialized outgoing PUBLISH packets, larger packets use the heap
+#ifndef MQTT_ARENA_SLOTS
+#define MQTT_ARENA_SLOTS 8
+#endif
+
+#ifndef MQTT_ARENA_SLOT_SIZE
+#define MQTT_ARENA_SLOT_SIZE 128
+#endif
+
+namespace AsyncMqttClientInternals {
+#if defined(ARDUINO_ARCH_ESP32)
+extern portMUX_TYPE poolMux;
+#define POOL_LOCK() portENTER_CRITICAL(&AsyncMqttClientInternals::poolMux)
+#define POOL_UNLOCK() portEXIT_CRITICAL(&AsyncMqttClientInternals::poolMux)
+#else
+#define POOL_LOCK()
+#define POOL_UNLOCK()
+#endif
+
+// Fixed capacity slab of SIZE byte blocks. When it is exhausted, or for bigger
+// requests, memory comes from the heap so callers never fail because of the pool.
+// All members are zero-initialized, pools can be used during static initialization.
+template <size_t SIZE, size_t CAPACITY>
+class Pool {
+ public:
+  void* allocate(size_t size) {
+    void* slot = nullptr;
+    POOL_LOCK();
+    if (size <= SIZE) {
+      if (_free) {
+        slot = _free;
+        _free = _free->next;
+      } else if (_fresh < CAPACITY) {
+        slot = &_slots[_fresh++];
+      }
+    }
+    if (slot) {
+      if (++_used > _highWater) _highWater = _used;
+    } else {
+      _fallbacks++;
+    }
+    POOL_UNLOCK();
+    return slot ? slot : ::operator new(size);
+  }
+
+  void deallocate(void* p) {
+    if (!p) return;
+    Slot* slot = static_cast<Slot*>(p);
+    if (slot < _slots || slot >= _slots + CAPACITY) {
+      ::operator delete(p);
+      return;
+    }
+    POOL_LOCK();
+    slot->next = _free;
+    _free = slot;
+    _used--;
+    POOL_UNLOCK();
+  }
+
+  AsyncMqttClientPoolUsage usage() const {
+    AsyncMqttClientPoolUsage usage;
+    usage.capacity = CAPACITY;
+    usage.used = _used;
+    usage.highWater = _highWater;
+    usage.fallbacks = _fallbacks;
+    return usage;
+  }
+
+ private:
+  union Slot {
+    Slot* next;
+    max_align_t align;
+    uint8_t storage[SIZE];
+  };
+
+  Slot _slots[CAPACITY > 0 ? CAPACITY : 1];
+  Slot* _free;
+  uint16_t _fresh;  // slots after this one were never handed out
+  uint16_t _used;
+  uint16_t _highWater;
+  uint32_t _fallbacks;
+};
+}  // namespace AsyncMqttClientInternals
@@ -0,0 +1,85 @@
+#include "Properties.hpp"
+
+using AsyncMqttClientInternals::PropertyReader;
+
+PropertyReader::PropertyReader()
+: _state(ID)
+, _id(0)
+, _strings(0)
+, _shift(0)
+, _remaining(0)
+, _value(0) {
+}
+
+bool PropertyReader::feed(uint8_t byte) {
+  switch (_state) {
+    case ID:
+      _id = byte;
+      _value = 0;
+      switch (byte) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+          _remaining = 1;
+          _state = INTEGER;
+          break;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+          _remaining = 2;
+          _state = INTEGER;
+          break;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+          _remaining = 4;
+          _state = INTEGER;
+          break;
+        case 0x0B:
+          _shift = 0;
+          _state = VARIABLE_INTEGER;
+          break;
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+          _strings = 1;
+          _state = LENGTH_MSB;
+          break;
+        case 0x26:  // user property, a string pair
+          _strings = 2;
+          _state = LENGTH_MSB;
+          break;
+        default:
+          _state = UNKNOWN;
+      }
+      return false;
+    case INTEGER:
+      _value = _value << 8 | byte;
+      if (--_remaining > 0) return false;
+      _state = ID;
+      return true;
+    case VARIABLE_INTEGER:
+      _value |= static_cast<uint32_t>(byte & 0x7F) << _shift;
+      _shift += 7;
+      if (byte & 0x80) return false;
+      _state = ID;
+      return true;
+    case LENGTH_MSB:
+      _remaining = byte << 8;
+      _state = LENGTH_LSB;
+      return false;
+    case LENGTH_LSB:
+      _remaining |= byte;
+      if (_remaining > 0) {
+        _state = SKIP;
+      } else {
+        _state = (--_strings > 0) ? LENGTH_MSB : ID;
+      }
+      return false;
+    case SKIP:
+      if (--_remaining == 0) _state = (--_strings > 0) ? LENGTH_MSB : ID;
+      return false;
+    default:
+      return false;
+  }
+}
+
+uint8_t PropertyReader::id() const {
+  return _id;
+}
+
+uint32_t PropertyReader::value() const {
+  return _value;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>  // uint*_t
+
+namespace AsyncMqttClientInternals {
+// Reads an MQTT 5.0 property section one byte at a time, so it works the same
+// on a packet held in one segment and on one straddling segments. Integer
+// properties are reported, strings and binary data are skipped.
+class PropertyReader {
+ public:
+  PropertyReader();
+  bool feed(uint8_t byte);  // a byte after the property length, true once an integer property is complete
+  uint8_t id() const;
+  uint32_t value() const;
+
+ private:
+  enum State : uint8_t {
+    ID,
+    INTEGER,
+    VARIABLE_INTEGER,
+    LENGTH_MSB,
+    LENGTH_LSB,
+    SKIP,
+    UNKNOWN  // an unknown property, the rest of the section cannot be read
+  };
+
+  State _state;
+  uint8_t _id;
+  uint8_t _strings;     // strings left in the property, 2 for a string pair
+  uint8_t _shift;
+  uint16_t _remaining;  // bytes left in the integer or the string
+  uint32_t _value;
+};
+}  // namespace AsyncMqttClientInternals
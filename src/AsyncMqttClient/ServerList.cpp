@@ -0,0 +1,98 @@
+#include "ServerList.hpp"
+
+#include <cstring>  // strcmp
+
+using AsyncMqttClientInternals::ServerEndpoint;
+using AsyncMqttClientInternals::ServerList;
+
+ServerEndpoint::ServerEndpoint(IPAddress ip, const char* host, uint16_t port)
+: ip(ip)
+, host(host)
+, port(port)
+, dns()
+, connectTime(0)
+, connAckTime(0)
+, pingTime(0)
+, rtt(0)
+, failures(0)
+#if ASYNC_TCP_SSL_ENABLED
+, tlsSession()
+#endif
+{
+}
+
+bool ServerEndpoint::is(IPAddress otherIp, const char* otherHost, uint16_t otherPort) const {
+  if (port != otherPort || (host == nullptr) != (otherHost == nullptr)) return false;
+  return host ? strcmp(host, otherHost) == 0 : ip == otherIp;
+}
+
+void ServerEndpoint::measure(uint32_t* last, uint32_t time) {
+  if (time == 0) time = 1;  // 0 means not measured
+  *last = time;
+  rtt = (rtt == 0) ? time : (7 * rtt + time) / 8;  // smoothed like the TCP SRTT
+}
+
+ServerList::ServerList()
+: _servers()
+, _current(0) {
+}
+
+void ServerList::set(IPAddress ip, const char* host, uint16_t port) {
+  if (_servers.size() == 1 && _servers[0].is(ip, host, port)) {
+    _servers[0].host = host;  // the same name, maybe in another buffer
+    return;
+  }
+  _servers.clear();
+  add(ip, host, port);
+}
+
+void ServerList::add(IPAddress ip, const char* host, uint16_t port) {
+  _servers.emplace_back(ip, host, port);
+  if (_servers.size() == 1) _current = 0;
+}
+
+size_t ServerList::size() const {
+  return _servers.size();
+}
+
+size_t ServerList::currentIndex() const {
+  return _current;
+}
+
+ServerEndpoint& ServerList::current() {
+  return _servers[_current];
+}
+
+ServerEndpoint& ServerList::operator[](size_t index) {
+  return _servers[index];
+}
+
+const ServerEndpoint& ServerList::operator[](size_t index) const {
+  return _servers[index];
+}
+
+ServerEndpoint* ServerList::find(const char* host) {
+  for (ServerEndpoint& server : _servers) {
+    if (server.host && strcmp(server.host, host) == 0) return &server;
+  }
+  return nullptr;
+}
+
+bool ServerList::select() {
+  size_t best = _current;
+  for (size_t index = 0; index < _servers.size(); index++) {
+    if (index != best && _better(_servers[index], _servers[best])) best = index;
+  }
+  if (best == _current) return false;
+  _current = best;
+  return true;
+}
+
+bool ServerList::_better(const ServerEndpoint& server, const ServerEndpoint& than) const {
+  bool failing = server.failures >= MQTT_SERVER_FAILOVER;
+  if (failing != (than.failures >= MQTT_SERVER_FAILOVER)) return !failing;
+  if (failing) return server.failures < than.failures;  // all failing: the one which failed least
+  if (server.rtt == 0 || than.rtt == 0) return server.rtt == 0 && than.rtt != 0;
+  if (&than == &_servers[_current]) return server.rtt * 4 < than.rtt * 3;  // not for a few ms
+  return server.rtt < than.rtt;
+}
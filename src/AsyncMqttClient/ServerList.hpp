@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint*_t
+#include <vector>
+
+#include "Arduino.h"  // IPAddress
+#include "DnsCache.hpp"
+#include "TlsSession.hpp"
+
+// Failed connections in a row after which the client moves to another server
+#ifndef MQTT_SERVER_FAILOVER
+#define MQTT_SERVER_FAILOVER 2
+#endif
+
+namespace AsyncMqttClientInternals {
+struct ServerEndpoint {
+  IPAddress ip;
+  const char* host;  // nullptr for an IP address
+  uint16_t port;
+  DnsCache dns;
+  uint32_t connectTime;  // last measures in ms, 0 until measured
+  uint32_t connAckTime;
+  uint32_t pingTime;
+  uint32_t rtt;          // smoothed over all the measures
+  uint8_t failures;      // connections failed in a row
+#if ASYNC_TCP_SSL_ENABLED
+  AsyncMqttClientTlsSession tlsSession;
+#endif
+
+  ServerEndpoint(IPAddress ip, const char* host, uint16_t port);
+  bool is(IPAddress ip, const char* host, uint16_t port) const;
+  void measure(uint32_t* last, uint32_t time);
+};
+
+// The servers to connect to, each with its round-trip time. A connection goes
+// to the server with the lowest one, the servers never measured first so that
+// each one is. The client moves away from a server which failed
+// MQTT_SERVER_FAILOVER times in a row, and from a server a quarter slower than
+// another one.
+class ServerList {
+ public:
+  ServerList();
+  void set(IPAddress ip, const char* host, uint16_t port);  // the only server, keeps its state if it is the same
+  void add(IPAddress ip, const char* host, uint16_t port);
+  size_t size() const;
+  size_t currentIndex() const;
+  ServerEndpoint& current();
+  ServerEndpoint& operator[](size_t index);
+  const ServerEndpoint& operator[](size_t index) const;
+  ServerEndpoint* find(const char* host);
+  bool select();  // pick the server to connect to, true if it changed
+
+ private:
+  bool _better(const ServerEndpoint& server, const ServerEndpoint& than) const;
+
+  std::vector<ServerEndpoint> _servers;
+  size_t _current;
+};
+}  // namespace AsyncMqttClientInternals
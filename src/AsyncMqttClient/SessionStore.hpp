@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>  // uint*_t
+#include <stddef.h>  // size_t
+#include <functional>
+#include <vector>
+
+typedef std::function<void(const uint8_t* data, size_t length)> OnSessionRecordCallback;
+
+// Piece of a record, so that a packet is journaled without being copied first
+struct AsyncMqttClientSessionRecordPart {
+  const uint8_t* data;
+  size_t length;
+};
+
+// Journal of the session state (QoS 1 and QoS 2 flows) which survives a reboot.
+// The client defines the records, a store only keeps them in order. It is called
+// with the client locked, so it must not call the client back.
+class AsyncMqttClientSessionStore {
+ public:
+  virtual ~AsyncMqttClientSessionStore() {}
+
+  // Append one record. Returns false if it could not be stored, the client then compacts the journal.
+  virtual bool append(const uint8_t* data, size_t length) = 0;
+  // Append one record given in parts, stored as if they were contiguous. By default they are copied into one buffer.
+  virtual bool append(const AsyncMqttClientSessionRecordPart* parts, size_t count) {
+    std::vector<uint8_t> record;
+    for (size_t i = 0; i < count; i++) record.insert(record.end(), parts[i].data, parts[i].data + parts[i].length);
+    return append(record.data(), record.size());
+  }
+  // Make the records appended so far durable, if append does not. Called about twice a second while connected.
+  virtual void sync() {}
+  // Call back every complete record, in the order they were appended. A torn last record is skipped.
+  virtual void replay(OnSessionRecordCallback callback) = 0;
+  // Start a new journal, the following appends go to it while the current one stays intact.
+  virtual bool beginRewrite() = 0;
+  // Atomically replace the current journal with the new one.
+  virtual bool commitRewrite() = 0;
+  // Drop the new journal after a failed rewrite or commit, appends go to the current one again.
+  virtual void abortRewrite() = 0;
+};
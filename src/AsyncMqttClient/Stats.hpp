@@ -0,0 +1,38 @@
+#pragma once
+
+struct AsyncMqttClientStats {
+  uint32_t packetsSent;   // MQTT packets completely handed to TCP
+  uint32_t segmentsSent;  // TCP sends used to push them
+  uint32_t queuedBytes;   // packets waiting to be handed to TCP
+  uint16_t queuedPackets;
+  uint32_t rejected;      // publishes refused because of the queue budget or low memory
+  uint16_t pendingPubRels;  // incoming QoS 2 messages awaiting PUBREL
+  uint16_t pendingPubRelsHighWater;
+  uint32_t reconnectAttempts;  // connections started by the reconnect engine
+  uint32_t offlineTime;        // ms spent disconnected, from a lost connection to the next accepted one
+  uint32_t tlsResumptions;     // TLS handshakes which resumed a cached session
+};
+
+struct AsyncMqttClientServerStats {
+  uint32_t connectTime;  // ms from connect() to the TCP (and TLS) connection, last measure
+  uint32_t connAckTime;  // ms from the connection to the CONNACK, last measure
+  uint32_t pingTime;     // ms from PINGREQ to PINGRESP, last measure
+  uint32_t rtt;          // smoothed over all the measures, the server with the lowest one is picked
+  uint8_t failures;      // connections failed in a row
+  bool current;          // picked for the last connection
+};
+
+struct AsyncMqttClientPoolUsage {
+  uint16_t capacity;
+  uint16_t used;
+  uint16_t highWater;
+  uint32_t fallbacks;  // allocations served by the heap because the pool was full or too small
+};
+
+struct AsyncMqttClientPoolStats {
+  AsyncMqttClientPoolUsage ackPackets;      // outgoing PUBACK, PUBREC, PUBREL and PUBCOMP
+  AsyncMqttClientPoolUsage pingPackets;     // outgoing PINGREQ
+  AsyncMqttClientPoolUsage disconnPackets;  // outgoing DISCONNECT
+  AsyncMqttClientPoolUsage publishPackets;  // outgoing PUBLISH
+  AsyncMqttClientPoolUsage publishBuffers;  // serialized outgoing PUBLISH, from the arena
+};
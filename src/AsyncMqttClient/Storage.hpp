@@ -1,13 +1,51 @@
 #pragma once
 
+#include <atomic>
+#include <string>
+
+#include "Arduino.h"  // IPAddress
+
+class AsyncMqttClient;
+
 namespace AsyncMqttClientInternals {
-struct PendingPubRel {
-  uint16_t packetId;
-};
+class OutPacket;
+
+// session journal records: type, packet ID, and for PUBLISH the serialized packet
+constexpr struct {
+  const uint8_t PUBLISH   = 'P';  // outgoing QoS 1 or QoS 2 PUBLISH queued
+  const uint8_t PUBREL    = 'R';  // PUBREC received for an outgoing QoS 2 PUBLISH
+  const uint8_t COMPLETED = 'A';  // outgoing flow acknowledged by PUBACK or PUBCOMP
+  const uint8_t PUBREC    = 'I';  // incoming QoS 2 PUBLISH waiting for PUBREL
+  const uint8_t RELEASED  = 'C';  // PUBREL received for an incoming QoS 2 PUBLISH
+} SessionRecord;
 
 struct PendingAck {
   uint8_t packetType;
   uint8_t headerFlag;
   uint16_t packetId;
 };
+
+struct OutLane {
+  OutPacket* head;
+  OutPacket* tail;
+};
+
+struct PendingTcpAck {
+  OutPacket* packet;
+  uint32_t ackedAt;  // value of the acked bytes counter once the packet left the TCP send buffer
+};
+
+// Host lookup handed to lwIP, which answers in its own thread and cannot cancel it.
+// The answer is only stored there, the client takes it under its lock. A destroyed
+// client detaches from it, and the answer frees it.
+struct DnsLookup {
+  DnsLookup(AsyncMqttClient* client, const char* host)
+  : client(client), host(host), address(), found(false), answered(false) {}
+
+  AsyncMqttClient* client;  // nullptr once detached
+  std::string host;
+  IPAddress address;
+  bool found;
+  std::atomic<bool> answered;  // set last, the fields above are complete then
+};
 }  // namespace AsyncMqttClientInternals
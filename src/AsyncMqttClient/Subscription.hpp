@@ -0,0 +1,11 @@
+#pragma once
+
+// Most topic filters in one SUBSCRIBE or UNSUBSCRIBE. The SUBACK parser keeps one byte per filter.
+#ifndef MQTT_SUBSCRIBE_BATCH_MAX
+#define MQTT_SUBSCRIBE_BATCH_MAX 16
+#endif
+
+struct AsyncMqttClientSubscription {
+  const char* topic;
+  uint8_t qos;
+};
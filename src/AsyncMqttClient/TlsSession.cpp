@@ -0,0 +1,23 @@
+#include "../AsyncMqttClient.hpp"
+
+#if ASYNC_TCP_SSL_ENABLED
+#include <cstring>  // memcpy
+
+void AsyncMqttClientAxTls::offerSession(AsyncClient* client, const uint8_t* id, uint8_t length) {
+  (void)client;
+  (void)id;
+  (void)length;
+}
+
+uint8_t AsyncMqttClientAxTls::sessionId(AsyncClient* client, uint8_t* id) {
+  SSL* ssl = client->getSSL();
+  uint8_t length = ssl_get_session_id_size(ssl);
+  if (length > MQTT_TLS_SESSION_ID_SIZE) return 0;
+  memcpy(id, ssl_get_session_id(ssl), length);
+  return length;
+}
+
+bool AsyncMqttClientAxTls::matchFingerprint(AsyncClient* client, const uint8_t* fingerprint) {
+  return ssl_match_fingerprint(client->getSSL(), fingerprint) == SSL_OK;
+}
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>  // uint*_t
+
+// Longest TLS session ID, and the size of an SHA1 fingerprint
+#define MQTT_TLS_SESSION_ID_SIZE 32
+#define MQTT_TLS_FINGERPRINT_SIZE 20
+
+// A TLS session to resume with a server. Plain bytes, it can be written to
+// flash as is and handed back after a reboot.
+struct AsyncMqttClientTlsSession {
+  uint8_t id[MQTT_TLS_SESSION_ID_SIZE];
+  uint8_t length;  // 0 if there is no session
+  uint8_t fingerprint[MQTT_TLS_FINGERPRINT_SIZE];  // the server certificate matched it when the session was made, zeros if none was checked
+};
+
+#if ASYNC_TCP_SSL_ENABLED
+class AsyncClient;
+
+// The TLS layer under the connection, as the client needs it for sessions and
+// fingerprints. The default one reads axTLS through the TCP library; another one
+// can offer sessions to a TCP library able to take them.
+class AsyncMqttClientTls {
+ public:
+  virtual ~AsyncMqttClientTls() {}
+  // before connecting: the session to offer in the ClientHello, none if length is 0
+  virtual void offerSession(AsyncClient* client, const uint8_t* id, uint8_t length) = 0;
+  // after the handshake: copies the session ID to id and returns its length, 0 if there is none
+  // or it is longer than MQTT_TLS_SESSION_ID_SIZE
+  virtual uint8_t sessionId(AsyncClient* client, uint8_t* id) = 0;
+  virtual bool matchFingerprint(AsyncClient* client, const uint8_t* fingerprint) = 0;  // of the server certificate
+};
+
+// axTLS through ESPAsyncTCP, which creates the axTLS session in connect() with no
+// session ID: nothing is offered, a session is only kept.
+class AsyncMqttClientAxTls : public AsyncMqttClientTls {
+ public:
+  void offerSession(AsyncClient* client, const uint8_t* id, uint8_t length);
+  uint8_t sessionId(AsyncClient* client, uint8_t* id);
+  bool matchFingerprint(AsyncClient* client, const uint8_t* fingerprint);
+};
+#endif
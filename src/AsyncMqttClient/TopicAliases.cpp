@@ -0,0 +1,37 @@
+#include "TopicAliases.hpp"
+
+using AsyncMqttClientInternals::TopicAliases;
+
+TopicAliases::TopicAliases()
+: _entries()
+, _maximum(0)
+, _clock(0) {
+}
+
+void TopicAliases::reset(uint16_t maximum) {
+  _entries.clear();
+  _maximum = (maximum < MQTT_TOPIC_ALIASES) ? maximum : MQTT_TOPIC_ALIASES;
+  _clock = 0;
+}
+
+uint16_t TopicAliases::alias(const char* topic, size_t length, bool* known) {
+  *known = false;
+  if (_maximum == 0 || length <= 3) return 0;  // the alias property takes 3 bytes
+  _clock++;
+  size_t oldest = 0;
+  for (size_t i = 0; i < _entries.size(); i++) {
+    if (_entries[i].topic.compare(0, std::string::npos, topic, length) == 0) {
+      _entries[i].lastUse = _clock;
+      *known = true;
+      return i + 1;
+    }
+    if (_entries[i].lastUse < _entries[oldest].lastUse) oldest = i;
+  }
+  if (_entries.size() < _maximum) {
+    _entries.push_back(Entry());
+    oldest = _entries.size() - 1;
+  }
+  _entries[oldest].topic.assign(topic, length);
+  _entries[oldest].lastUse = _clock;
+  return oldest + 1;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>  // uint*_t
+#include <stddef.h>  // size_t
+#include <string>
+#include <vector>
+
+// Most outgoing topic aliases per connection (MQTT 5.0), fewer if the broker allows fewer. 0 disables them.
+#ifndef MQTT_TOPIC_ALIASES
+#define MQTT_TOPIC_ALIASES 16
+#endif
+
+namespace AsyncMqttClientInternals {
+// Outgoing topic aliases of one connection. Topics get an alias in the order
+// they are published; once all are in use, the least recently used one is
+// given to the new topic.
+class TopicAliases {
+ public:
+  TopicAliases();
+  void reset(uint16_t maximum);  // on each connection, with the Topic Alias Maximum of the broker
+  // the alias to publish the topic with, 0 if none. *known is false when the broker does not have it yet:
+  // the topic has to be sent along with it.
+  uint16_t alias(const char* topic, size_t length, bool* known);
+
+ private:
+  struct Entry {
+    std::string topic;
+    uint32_t lastUse;
+  };
+
+  std::vector<Entry> _entries;  // the alias is the index + 1
+  uint16_t _maximum;
+  uint32_t _clock;
+};
+}  // namespace AsyncMqttClientInternals
@@ -0,0 +1,94 @@
+#include "TopicTrie.hpp"
+
+#include <cstring>  // strchr, strlen
+#include <algorithm>  // std::lower_bound
+
+using AsyncMqttClientInternals::TopicTrie;
+using AsyncMqttClientInternals::TopicRoute;
+
+TopicTrie::Node::Node()
+: level()
+, children()
+, plus(nullptr)
+, hash(nullptr)
+, route(nullptr) {
+}
+
+TopicTrie::Node::~Node() {
+  for (Node* node : children) delete node;
+  delete plus;
+  delete hash;
+  delete route;
+}
+
+TopicTrie::Node* TopicTrie::Node::child(const char* level, size_t length) const {
+  auto it = std::lower_bound(children.begin(), children.end(), level, [length](const Node* node, const char* other) {
+    return node->level.compare(0, std::string::npos, other, length) < 0;
+  });
+  if (it == children.end() || (*it)->level.compare(0, std::string::npos, level, length) != 0) return nullptr;
+  return *it;
+}
+
+TopicTrie::Node* TopicTrie::Node::addChild(const char* level, size_t length) {
+  if (length == 1 && level[0] == '+') {
+    if (!plus) plus = new Node();
+    return plus;
+  }
+  if (length == 1 && level[0] == '#') {
+    if (!hash) hash = new Node();
+    return hash;
+  }
+  auto it = std::lower_bound(children.begin(), children.end(), level, [length](const Node* node, const char* other) {
+    return node->level.compare(0, std::string::npos, other, length) < 0;
+  });
+  if (it != children.end() && (*it)->level.compare(0, std::string::npos, level, length) == 0) return *it;
+  Node* node = new Node();
+  node->level.assign(level, length);
+  children.insert(it, node);
+  return node;
+}
+
+TopicTrie::TopicTrie()
+: _root(new Node()) {
+}
+
+TopicTrie::~TopicTrie() {
+  delete _root;
+}
+
+TopicRoute& TopicTrie::insert(const char* filter) {
+  Node* node = _root;
+  const char* level = filter;
+  while (true) {
+    const char* end = strchr(level, '/');
+    size_t length = end ? static_cast<size_t>(end - level) : strlen(level);
+    node = node->addChild(level, length);
+    if (!end) break;
+    level = end + 1;
+  }
+  if (!node->route) node->route = new TopicRoute();
+  return *node->route;
+}
+
+TopicRoute* TopicTrie::find(const char* filter) const {
+  const Node* node = _root;
+  const char* level = filter;
+  while (node) {
+    const char* end = strchr(level, '/');
+    size_t length = end ? static_cast<size_t>(end - level) : strlen(level);
+    if (length == 1 && level[0] == '+') {
+      node = node->plus;
+    } else if (length == 1 && level[0] == '#') {
+      node = node->hash;
+    } else {
+      node = node->child(level, length);
+    }
+    if (!end) break;
+    level = end + 1;
+  }
+  return node ? node->route : nullptr;
+}
+
+bool TopicTrie::empty() const {
+  return _root->children.empty() && !_root->plus && !_root->hash;
+}
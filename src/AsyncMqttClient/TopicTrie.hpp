@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>  // size_t
+#include <string>
+#include <vector>
+
+#include "Callbacks.hpp"
+
+namespace AsyncMqttClientInternals {
+// What is attached to one topic filter
+struct TopicRoute {
+  enum Subscription : uint8_t {
+    UNSUBSCRIBED,
+    PENDING,     // SUBSCRIBE queued or sent, not acknowledged yet
+    SUBSCRIBED
+  };
+
+  std::vector<OnMessageUserCallback> handlers;
+  Subscription subscription = UNSUBSCRIBED;
+  uint8_t qos = 0;  // requested, then granted
+};
+
+// Topic filters stored level by level, with the + and # wildcards. Matching a
+// topic walks it once and visits every matching filter once, however many
+// handlers are attached to it.
+class TopicTrie {
+ public:
+  TopicTrie();
+  ~TopicTrie();
+  TopicTrie(const TopicTrie&) = delete;
+  TopicTrie& operator=(const TopicTrie&) = delete;
+
+  TopicRoute& insert(const char* filter);
+  TopicRoute* find(const char* filter) const;
+  bool empty() const;
+
+  // calls visit(TopicRoute&) for each filter matching the topic
+  template <typename Visitor>
+  void match(const char* topic, Visitor visit) const {
+    _match(_root, topic, true, visit);
+  }
+
+  // calls visit(const std::string& filter, TopicRoute&) for each filter
+  template <typename Visitor>
+  void forEach(Visitor visit) const {
+    std::string filter;
+    _forEach(_root, &filter, true, visit);
+  }
+
+ private:
+  struct Node {
+    std::string level;
+    std::vector<Node*> children;  // sorted by level
+    Node* plus;                   // + child
+    Node* hash;                   // # child
+    TopicRoute* route;            // set if a filter ends here
+
+    Node();
+    ~Node();
+    Node* child(const char* level, size_t length) const;
+    Node* addChild(const char* level, size_t length);
+  };
+
+  template <typename Visitor>
+  static void _match(const Node* node, const char* level, bool first, Visitor& visit) {
+    // level is nullptr once the whole topic is consumed. Wildcards do not
+    // match a first level starting with $, such as $SYS.
+    bool wildcards = !(first && level && *level == '$');
+    if (node->hash && node->hash->route && wildcards) visit(*node->hash->route);  // # also matches the parent level
+    if (!level) {
+      if (node->route) visit(*node->route);
+      return;
+    }
+    const char* end = level;
+    while (*end && *end != '/') end++;
+    const char* next = (*end == '/') ? end + 1 : nullptr;
+    const Node* child = node->child(level, end - level);
+    if (child) _match(child, next, false, visit);
+    if (node->plus && wildcards) _match(node->plus, next, false, visit);
+  }
+
+  template <typename Visitor>
+  static void _forEach(const Node* node, std::string* filter, bool first, Visitor& visit) {
+    size_t length = filter->size();
+    auto visitChild = [filter, length, first, &visit](const Node* child, const char* level) {
+      if (!first) filter->push_back('/');
+      filter->append(level);
+      if (child->route) visit(*filter, *child->route);
+      _forEach(child, filter, false, visit);
+      filter->resize(length);
+    };
+    for (const Node* child : node->children) visitChild(child, child->level.c_str());
+    if (node->plus) visitChild(node->plus, "+");
+    if (node->hash) visitChild(node->hash, "#");
+  }
+
+  Node* _root;
+};
+}  // namespace AsyncMqttClientInternals
@@ -0,0 +1,34 @@
+#include "test.hpp"
+
+// the properties of the MQTT 5.0 CONNECT the client sends, without their length
+static std::string connectProperties(AsyncMqttClient& client) {
+  client.connect();
+  tcp(client).accept();
+  std::vector<WirePacket> sent = packets(tcp(client).takeSent());
+  CHECK(sent.size() == 1 && sent[0].type == 1);
+  const std::string& body = sent[0].body;
+  size_t position = 2 + 4 + 1 + 1 + 2;  // protocol name, level, flags and keep alive
+  CHECK(body.compare(0, 7, std::string("\x00\x04MQTT\x05", 7)) == 0);
+  return body.substr(position + 1, static_cast<uint8_t>(body[position]));
+}
+
+TEST(keptSessionNeverExpiresByDefault) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setProtocolVersion(5).setCleanSession(false);
+  std::string properties = connectProperties(client);
+  CHECK(properties.find(std::string("\x11\xFF\xFF\xFF\xFF", 5)) != std::string::npos);
+}
+
+TEST(keptSessionExpiresAfterTheSetInterval) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setProtocolVersion(5).setCleanSession(false).setSessionExpiryInterval(3600);
+  std::string properties = connectProperties(client);
+  CHECK(properties.find(std::string("\x11\x00\x00\x0E\x10", 5)) != std::string::npos);
+}
+
+TEST(cleanSessionSendsNoExpiryInterval) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setProtocolVersion(5);
+  std::string properties = connectProperties(client);
+  CHECK(properties == std::string("\x21", 1) + uint16(MQTT_PENDING_PUBREL_SLOTS - 1));  // the receive maximum only
+}
@@ -0,0 +1,85 @@
+#include "test.hpp"
+
+#include <freertos/semphr.h>
+#include <lwip/dns.h>
+
+static const IPAddress first(10, 0, 0, 1);
+static const IPAddress second(10, 0, 0, 2);
+
+// accepts the connection from address, and the CONNECT
+static void accept(AsyncMqttClient& client, IPAddress address) {
+  tcp(client).ip = address;
+  tcp(client).accept();
+  tcp(client).takeSent();
+  tcp(client).ack();
+  tcp(client).receive(connAck());
+  CHECK(client.connected());
+}
+
+static void reconnect(AsyncMqttClient& client) {
+  tcp(client).drop();
+  client.connect();
+}
+
+TEST(connectsToTheCachedAddressAndRefreshesItInTheBackground) {
+  TestDns& dns = testDns();
+  dns = TestDns();
+  dns.records["broker"] = static_cast<uint32_t>(first);
+  AsyncMqttClient client;
+  client.setServer("broker", 1883);
+  client.connect();
+  CHECK(tcp(client).host == "broker" && dns.lookups == 0);  // nothing cached: the TCP library looks it up
+  accept(client, first);
+  reconnect(client);
+  CHECK(tcp(client).host.empty() && tcp(client).ip == first && dns.lookups == 0);
+  accept(client, first);
+
+  advanceMillis(MQTT_DNS_CACHE_TTL);
+  tcp(client).poll();
+  CHECK(dns.lookups == 1);
+  tcp(client).poll();
+  CHECK(dns.lookups == 1);  // one at a time
+  dns.records["broker"] = static_cast<uint32_t>(second);
+  answerLookup();
+  reconnect(client);
+  CHECK(tcp(client).ip == second);  // the newest address first
+  reconnect(client);
+  CHECK(tcp(client).ip == first);   // then the older one
+}
+
+TEST(answersDoNotTakeTheClientLockInTheLwipThread) {
+  TestDns& dns = testDns();
+  dns = TestDns();
+  dns.records["broker"] = static_cast<uint32_t>(first);
+  AsyncMqttClient client;
+  client.setServer("broker", 1883);
+  client.connect();
+  accept(client, first);
+  advanceMillis(MQTT_DNS_CACHE_TTL);
+  tcp(client).poll();
+  CHECK(dns.lookups == 1);
+  testLocksInLwipThread = 0;
+  answerLookup();
+  CHECK(testLocksInLwipThread == 0);
+  tcp(client).poll();  // taken from there
+  CHECK(client.getServerStats(0).current);
+  reconnect(client);
+  CHECK(tcp(client).ip == first && dns.lookups == 1);
+}
+
+TEST(aLookupOutlivesItsClient) {
+  TestDns& dns = testDns();
+  dns = TestDns();
+  dns.records["broker"] = static_cast<uint32_t>(first);
+  {
+    AsyncMqttClient client;
+    client.setServer("broker", 1883);
+    client.connect();
+    accept(client, first);
+    advanceMillis(MQTT_DNS_CACHE_TTL);
+    tcp(client).poll();
+    CHECK(dns.found != nullptr);
+  }
+  answerLookup();  // into nothing, and freed
+  CHECK(dns.found == nullptr);
+}
@@ -0,0 +1,62 @@
+#include "test.hpp"
+
+#include "AsyncMqttClient/PacketIdSet.hpp"
+
+using AsyncMqttClientInternals::PacketIdSet;
+
+TEST(insertsLooksUpAndErases) {
+  PacketIdSet set;
+  CHECK(set.insert(5) && set.insert(5));  // once
+  CHECK(set.size() == 1 && set.contains(5) && !set.contains(6));
+  CHECK(!set.insert(0) && !set.contains(0));  // 0 is no packet ID
+  CHECK(set.erase(5) && !set.erase(5));
+  CHECK(set.size() == 0 && !set.contains(5));
+}
+
+TEST(keepsCollidingIdsReachableAcrossErases) {
+  PacketIdSet set;
+  const size_t slots = MQTT_PENDING_PUBREL_SLOTS;
+  // the same home slot, the last one wrapping around the end of the table
+  uint16_t colliding[] = {slots - 1, 2 * slots - 1, 3 * slots - 1, 4 * slots - 1};
+  for (uint16_t packetId : colliding) CHECK(set.insert(packetId));
+  CHECK(set.insert(1));  // home slot taken over by the wrapped probe sequence
+  CHECK(set.erase(2 * slots - 1));
+  for (uint16_t packetId : {colliding[0], colliding[2], colliding[3], static_cast<uint16_t>(1)}) CHECK(set.contains(packetId));
+  CHECK(set.erase(colliding[0]));
+  CHECK(set.contains(colliding[2]) && set.contains(colliding[3]) && set.contains(1));
+  CHECK(set.size() == 3);
+}
+
+TEST(refusesIdsOnceFullAndKeepsItsHighWater) {
+  PacketIdSet set;
+  const uint16_t capacity = MQTT_PENDING_PUBREL_SLOTS - 1;  // one slot stays free
+  for (uint16_t packetId = 1; packetId <= capacity; packetId++) CHECK(set.insert(packetId * 7));
+  CHECK(!set.insert(60000));
+  CHECK(!set.contains(60000));  // a lookup still ends
+  CHECK(set.insert(7));         // already in
+  CHECK(set.size() == capacity && set.highWater() == capacity);
+  size_t visited = 0;
+  set.forEach([&](uint16_t packetId) {
+    CHECK(packetId % 7 == 0);
+    visited++;
+  });
+  CHECK(visited == capacity);
+  set.clear();
+  CHECK(set.size() == 0 && !set.contains(7) && set.highWater() == capacity);
+}
+
+TEST(clientDeliversAQos2MessageOnceUntilReleased) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883);
+  int delivered = 0;
+  client.onMessage([&](char*, char*, AsyncMqttClientMessageProperties, size_t, size_t, size_t) { delivered++; });
+  connectClient(client);
+  tcp(client).receive(publish("t", "once", 2, 42));
+  tcp(client).receive(publish("t", "once", 2, 42, true));
+  CHECK(delivered == 1);
+  std::vector<WirePacket> sent = packets(tcp(client).takeSent());
+  CHECK(sent.size() == 2 && sent[0].type == 5 && sent[1].type == 5 && sent[1].packetId() == 42);  // PUBREC each time
+  tcp(client).receive(ack(6, 42, 0x02));  // PUBREL
+  tcp(client).receive(publish("t", "again", 2, 42));
+  CHECK(delivered == 2);  // a new message with the released ID
+}
@@ -0,0 +1,96 @@
+#include "test.hpp"
+
+#include "AsyncMqttClient/PacketIds.hpp"
+
+using AsyncMqttClientInternals::PacketIds;
+
+TEST(allocatesInOrderAndReleases) {
+  PacketIds ids;
+  CHECK(ids.allocate() == 1);
+  CHECK(ids.allocate() == 2);
+  ids.release(1);
+  CHECK(ids.used() == 1);
+  CHECK(ids.allocate() == 3);
+  ids.release(0);     // never handed out
+  ids.release(1234);  // not in use
+  CHECK(ids.used() == 2);
+}
+
+TEST(fullWindowReusesIdsFreedBehindTheOldest) {
+  PacketIds ids;
+  uint16_t oldest = ids.allocate();
+  int allocated = 1;
+  while (ids.allocate()) allocated++;
+  CHECK(allocated == MQTT_PACKET_ID_WINDOW);
+  CHECK(ids.used() == MQTT_PACKET_ID_WINDOW);
+  ids.release(5);
+  CHECK(ids.allocate() == 5);
+  CHECK(ids.allocate() == 0);
+  // the window slides once the oldest is released
+  ids.release(oldest);
+  CHECK(ids.allocate() == MQTT_PACKET_ID_WINDOW + 1);
+}
+
+TEST(pinnedIdDoesNotStopAllocation) {
+  PacketIds ids;
+  uint16_t pinned = ids.allocate();
+  for (int i = 0; i < 3 * MQTT_PACKET_ID_WINDOW; i++) {
+    uint16_t id = ids.allocate();
+    CHECK(id != 0 && id != pinned);
+    ids.release(id);
+  }
+  CHECK(ids.used() == 1);
+}
+
+TEST(wrapsAroundWithoutZeroOrDuplicates) {
+  PacketIds ids;
+  uint16_t held = ids.allocate();
+  for (int i = 0; i < 140000; i++) {
+    uint16_t id = ids.allocate();
+    CHECK(id != 0 && id != held);
+    ids.release(id);
+    if (i % 50000 == 0) {
+      ids.release(held);
+      held = ids.allocate();
+    }
+  }
+}
+
+TEST(reservesRestoredIds) {
+  PacketIds ids;
+  CHECK(ids.reserve(65530));
+  CHECK(ids.reserve(65534));
+  CHECK(ids.reserve(65534));  // already reserved
+  CHECK(ids.used() == 2);
+  CHECK(ids.allocate() == 65535);
+  CHECK(ids.allocate() == 1);
+  CHECK(!ids.reserve(30000));  // out of the window
+  CHECK(!ids.reserve(0));
+  ids.clear();
+  CHECK(ids.used() == 0);
+  CHECK(ids.allocate() == 2);  // carries on rather than reusing 1 right away
+}
+
+TEST(clientReportsExhaustionAndNotifiesWhenAnIdIsFree) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setMaxInflight(MQTT_PACKET_ID_WINDOW);
+  std::vector<AsyncMqttClientError> errors;
+  int writable = 0;
+  client.onError([&](uint16_t packetId, AsyncMqttClientError error) {
+    if (packetId == 0) errors.push_back(error);
+  });
+  client.onWritable([&]() { writable++; });
+  connectClient(client);
+
+  std::vector<uint16_t> ids;
+  while (uint16_t id = client.publish("t", 1, false, "x")) ids.push_back(id);
+  CHECK(ids.size() == MQTT_PACKET_ID_WINDOW);
+  CHECK(errors.size() == 1 && errors[0] == AsyncMqttClientError::NO_PACKET_ID);
+  CHECK(client.publish("t", 0, false, "x") == 1);  // QoS 0 needs no ID
+  tcp(client).takeSent();
+  tcp(client).ack();
+
+  tcp(client).receive(ack(4, ids[10]));  // PUBACK
+  CHECK(writable == 1);
+  CHECK(client.publish("t", 1, false, "x") == ids[10]);
+}
@@ -0,0 +1,113 @@
+#include "test.hpp"
+
+#include <stdio.h>
+
+// Inbound packets are parsed in place when they are whole in a TCP segment, and by the byte
+// parsers when they straddle segments. Both must reach the client the same way.
+
+typedef std::function<void(const std::string& packet)> Feed;
+typedef std::function<void(AsyncMqttClient& client, const Feed& feed)> Exchange;
+
+static std::string hex(const std::string& bytes) {
+  std::string text;
+  char digits[3];
+  for (char byte : bytes) {
+    snprintf(digits, sizeof(digits), "%02x", static_cast<uint8_t>(byte));
+    text += digits;
+  }
+  return text;
+}
+
+// Runs exchange with every packet cut into segments of segmentSize bytes, 0 for whole packets,
+// and returns what the client did: its callbacks and what it sent in answer to each packet.
+static std::vector<std::string> run(uint8_t protocolVersion, size_t segmentSize, const Exchange& exchange) {
+  std::vector<std::string> log;
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setProtocolVersion(protocolVersion);
+  std::string message;
+  client.onConnect([&](bool sessionPresent) { log.push_back("connect " + std::to_string(sessionPresent)); });
+  client.onDisconnect([&](AsyncMqttClientDisconnectReason reason) { log.push_back("disconnect " + std::to_string(static_cast<int>(reason))); });
+  client.onSubscribeResults([&](uint16_t packetId, const uint8_t* returnCodes, size_t count) {
+    log.push_back("subscribe " + std::to_string(packetId) + " " + hex(std::string(returnCodes, returnCodes + count)));
+  });
+  client.onUnsubscribe([&](uint16_t packetId) { log.push_back("unsubscribe " + std::to_string(packetId)); });
+  client.onPublish([&](uint16_t packetId) { log.push_back("published " + std::to_string(packetId)); });
+  client.onError([&](uint16_t packetId, AsyncMqttClientError error) {
+    log.push_back("error " + std::to_string(packetId) + " " + std::to_string(static_cast<int>(error)));
+  });
+  client.onMessage([&](char* topic, char* payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total) {
+    CHECK(index == message.size());
+    if (len > 0) message.append(payload, len);
+    if (index + len < total) return;  // more chunks to come
+    log.push_back("message " + std::string(topic) + " " + message + " " + std::to_string(properties.qos) +
+                  std::to_string(properties.dup) + std::to_string(properties.retain));
+    message.clear();
+  });
+
+  Feed feed = [&](const std::string& packet) {
+    size_t step = (segmentSize == 0) ? packet.size() : segmentSize;
+    for (size_t position = 0; position < packet.size(); position += step) {
+      tcp(client).receive(packet.substr(position, step));
+    }
+    std::string sent = tcp(client).takeSent();
+    if (!sent.empty()) log.push_back("sent " + hex(sent));
+    tcp(client).ack();
+  };
+  client.connect();
+  tcp(client).accept();
+  tcp(client).takeSent();
+  tcp(client).ack();
+  exchange(client, feed);
+  return log;
+}
+
+static void checkParity(uint8_t protocolVersion, const Exchange& exchange) {
+  std::vector<std::string> whole = run(protocolVersion, 0, exchange);
+  CHECK(!whole.empty());
+  CHECK(run(protocolVersion, 1, exchange) == whole);
+  CHECK(run(protocolVersion, 3, exchange) == whole);
+}
+
+TEST(parsesMqtt311PacketsAlikeWholeOrSplit) {
+  checkParity(4, [](AsyncMqttClient& client, const Feed& feed) {
+    feed(connAck(true));
+    uint16_t subscribed = client.subscribe("a/#", 2);
+    uint16_t refused = client.subscribe("b", 1);
+    uint16_t unsubscribed = client.unsubscribe("c");
+    uint16_t once = client.publish("out", 1, false, "1");
+    uint16_t exactlyOnce = client.publish("out", 2, false, "2");
+    tcp(client).takeSent();
+    feed(subAck(subscribed, {2}));
+    feed(subAck(refused, {0x80}));
+    feed(ack(11, unsubscribed));  // UNSUBACK
+    feed(ack(4, once));           // PUBACK
+    feed(ack(5, exactlyOnce));    // PUBREC
+    feed(ack(7, exactlyOnce));    // PUBCOMP
+    feed(publish("a/zero", "at most once"));
+    std::string retained = publish("a/retained", "");
+    retained[0] |= 0x01;
+    feed(retained);
+    feed(publish("a/long", std::string(300, 'x'), 1, 10));  // two bytes of remaining length
+    feed(publish("a/two", "exactly once", 2, 11));
+    feed(publish("a/two", "exactly once", 2, 11, true));  // a duplicate, not delivered again
+    feed(ack(6, 11, 0x02));  // PUBREL
+    feed(packet(0xD0, ""));  // PINGRESP
+  });
+}
+
+TEST(parsesMqtt5PacketsAlikeWholeOrSplit) {
+  checkParity(5, [](AsyncMqttClient& client, const Feed& feed) {
+    feed(packet(0x20, std::string("\x00\x00\x03\x21\x00\x0A", 6)));  // CONNACK, receive maximum 10
+    uint16_t subscribed = client.subscribe("a/#", 1);
+    uint16_t once = client.publish("out", 1, false, "1");
+    uint16_t refused = client.publish("out", 2, false, "2");
+    tcp(client).takeSent();
+    feed(packet(0x90, uint16(subscribed) + std::string("\x05\x1F\x00\x02ok\x01", 7)));  // reason string
+    feed(packet(0x40, uint16(once) + std::string("\x00\x00", 2)));                     // PUBACK with a reason code
+    feed(packet(0x50, uint16(refused) + std::string("\x87\x00", 2)));                  // PUBREC, not authorized
+    // PUBLISH with a payload format indicator
+    feed(packet(0x32, uint16(3) + "a/b" + uint16(12) + std::string("\x02\x01\x01", 3) + "with properties"));
+    feed(packet(0x30, uint16(3) + "a/c" + std::string("\x00", 1) + "without"));
+    feed(packet(0xE0, std::string("\x8E\x00", 2)));  // DISCONNECT, session taken over
+  });
+}
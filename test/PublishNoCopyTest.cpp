@@ -0,0 +1,75 @@
+#include "test.hpp"
+
+#include <freertos/timers.h>
+
+// publishes "payload" from a buffer of the test, and counts its releases
+static uint16_t publishNoCopy(AsyncMqttClient& client, uint8_t qos, int& releases) {
+  static const char payload[] = "payload";
+  return client.publishNoCopy("t", qos, false, payload, sizeof(payload) - 1, [&releases](const char*, size_t) { releases++; });
+}
+
+// lets the retransmission timer of a sent packet expire, and returns what was sent again
+static std::vector<WirePacket> retransmit(AsyncMqttClient& client) {
+  advanceMillis(1000);
+  tcp(client).poll();
+  return packets(tcp(client).takeSent());
+}
+
+TEST(releasesThePayloadOnTheAck) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setRetransmission(1000, 3);
+  connectClient(client);
+  int releases = 0;
+  uint16_t packetId = publishNoCopy(client, 1, releases);
+  tcp(client).takeSent();
+  tcp(client).ack();
+  tcp(client).receive(ack(4, packetId));  // PUBACK
+  CHECK(releases == 1);
+}
+
+TEST(keepsARetransmittedPayloadUntilTcpAckedIt) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setRetransmission(1000, 3);
+  connectClient(client);
+  int releases = 0;
+  uint16_t packetId = publishNoCopy(client, 1, releases);
+  tcp(client).takeSent();
+  tcp(client).ack();
+  std::vector<WirePacket> sent = retransmit(client);
+  CHECK(sent.size() == 1 && publishId(sent[0]) == packetId && (sent[0].flags & 0x08) != 0);
+  tcp(client).receive(ack(4, packetId));  // PUBACK of the first copy, the second is still in TCP
+  CHECK(releases == 0);
+  tcp(client).ack();
+  CHECK(releases == 1);
+}
+
+TEST(keepsARetransmittedPayloadUntilTcpAckedItOnPubRec) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setRetransmission(1000, 3);
+  connectClient(client);
+  int releases = 0;
+  uint16_t packetId = publishNoCopy(client, 2, releases);
+  tcp(client).takeSent();
+  tcp(client).ack();
+  retransmit(client);
+  tcp(client).receive(ack(5, packetId));  // PUBREC
+  CHECK(releases == 0);
+  std::vector<WirePacket> sent = packets(tcp(client).takeSent());
+  CHECK(sent.size() == 1 && sent[0].type == 6 && sent[0].packetId() == packetId);  // PUBREL
+  tcp(client).ack();
+  CHECK(releases == 1);
+}
+
+TEST(releasesARetransmittedPayloadWhenTheConnectionDrops) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setRetransmission(1000, 3);
+  connectClient(client);
+  int releases = 0;
+  uint16_t packetId = publishNoCopy(client, 1, releases);
+  tcp(client).takeSent();
+  tcp(client).ack();
+  retransmit(client);
+  tcp(client).receive(ack(4, packetId));
+  tcp(client).drop();
+  CHECK(releases == 1);
+}
@@ -0,0 +1,76 @@
+#include "test.hpp"
+
+#include "AsyncMqttClient/ServerList.hpp"
+
+using AsyncMqttClientInternals::ServerList;
+
+static ServerList threeServers() {
+  ServerList servers;
+  servers.add(IPAddress(), "a", 1883);
+  servers.add(IPAddress(), "b", 1883);
+  servers.add(IPAddress(10, 0, 0, 3), nullptr, 1883);
+  return servers;
+}
+
+TEST(measuresEachServerBeforePickingTheFastest) {
+  ServerList servers = threeServers();
+  CHECK(!servers.select() && servers.currentIndex() == 0);  // none measured yet
+  servers[0].measure(&servers[0].connectTime, 50);
+  CHECK(servers.select() && servers.currentIndex() == 1);
+  servers[1].measure(&servers[1].connectTime, 40);
+  CHECK(servers.select() && servers.currentIndex() == 2);
+  servers[2].measure(&servers[2].connectTime, 10);
+  CHECK(!servers.select() && servers.currentIndex() == 2);
+  servers[2].measure(&servers[2].pingTime, 400);  // smoothed: (7 * 10 + 400) / 8
+  CHECK(servers[2].rtt == 58 && servers[2].pingTime == 400);
+  CHECK(servers.select() && servers.currentIndex() == 1);
+}
+
+TEST(staysWithAServerLessThanAQuarterSlower) {
+  ServerList servers = threeServers();
+  servers[0].measure(&servers[0].connectTime, 100);
+  servers[1].measure(&servers[1].connectTime, 80);
+  servers[2].measure(&servers[2].connectTime, 90);
+  CHECK(!servers.select() && servers.currentIndex() == 0);
+  servers[0].measure(&servers[0].connectTime, 280);  // (7 * 100 + 280) / 8
+  CHECK(servers[0].rtt == 122);
+  CHECK(servers.select() && servers.currentIndex() == 1);  // the fastest, not just a faster one
+}
+
+TEST(movesAwayFromAFailingServer) {
+  ServerList servers = threeServers();
+  for (size_t i = 0; i < servers.size(); i++) servers[i].measure(&servers[i].connectTime, 10 * (i + 1));
+  servers[0].failures = MQTT_SERVER_FAILOVER - 1;
+  CHECK(!servers.select());
+  servers[0].failures = MQTT_SERVER_FAILOVER;
+  CHECK(servers.select() && servers.currentIndex() == 1);
+  for (size_t i = 0; i < servers.size(); i++) servers[i].failures = MQTT_SERVER_FAILOVER + 2 - i;
+  CHECK(servers.select() && servers.currentIndex() == 2);  // all failing: the one which failed least
+}
+
+TEST(keepsTheStateOfAServerSetAgain) {
+  ServerList servers;
+  servers.set(IPAddress(), "broker", 1883);
+  servers.current().measure(&servers.current().connectTime, 25);
+  char host[] = "broker";
+  servers.set(IPAddress(), host, 1883);
+  CHECK(servers.size() == 1 && servers.current().rtt == 25 && servers.current().host == host);
+  CHECK(servers.find("broker") == &servers.current() && servers.find("other") == nullptr);
+  servers.set(IPAddress(), "broker", 8883);
+  CHECK(servers.size() == 1 && servers.current().rtt == 0);
+}
+
+TEST(clientFailsOverAfterFailedConnections) {
+  AsyncMqttClient client;
+  client.setServer("primary", 1883).addServer("backup", 1883);
+  for (int attempt = 0; attempt < MQTT_SERVER_FAILOVER; attempt++) {
+    client.connect();
+    CHECK(tcp(client).host == "primary");
+    tcp(client).drop();  // refused
+  }
+  CHECK(client.getServerStats(0).failures == MQTT_SERVER_FAILOVER);
+  connectClient(client);
+  CHECK(tcp(client).host == "backup");
+  CHECK(client.getServerStats(1).current && client.getServerStats(1).failures == 0);
+  CHECK(client.getServerStats(1).connectTime > 0);
+}
@@ -0,0 +1,213 @@
+#include "test.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>  // truncate
+
+#include <algorithm>
+
+// NOR flash in RAM: erased bytes read as 0xFF and writes only clear bits
+struct RamFlash : AsyncMqttClientFlash {
+  std::vector<uint8_t> memory;
+  int erases;
+
+  explicit RamFlash(size_t size) : memory(size, 0x00), erases(0) {}  // not erased: garbage is no journal
+  size_t size() const { return memory.size(); }
+  size_t sectorSize() const { return 4096; }
+  bool read(size_t offset, uint8_t* data, size_t length) {
+    memcpy(data, &memory[offset], length);
+    return true;
+  }
+  bool write(size_t offset, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) memory[offset + i] &= data[i];
+    return true;
+  }
+  bool erase(size_t offset, size_t length) {
+    CHECK(offset % 4096 == 0 && length % 4096 == 0);
+    memset(&memory[offset], 0xFF, length);
+    erases++;
+    return true;
+  }
+  // the offset of the last copy of record in memory
+  size_t find(const std::string& record) const {
+    auto it = std::find_end(memory.begin(), memory.end(), record.begin(), record.end());
+    CHECK(it != memory.end());
+    return it - memory.begin();
+  }
+};
+
+static bool append(AsyncMqttClientSessionStore& store, const std::string& record) {
+  return store.append(reinterpret_cast<const uint8_t*>(record.data()), record.size());
+}
+
+static std::vector<std::string> replay(AsyncMqttClientSessionStore& store) {
+  std::vector<std::string> records;
+  store.replay([&](const uint8_t* data, size_t length) {
+    records.push_back(std::string(reinterpret_cast<const char*>(data), length));
+  });
+  return records;
+}
+
+static const char* journal(const char* name) {
+  remove(name);
+  return name;
+}
+
+static long fileSize(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return -1;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+TEST(fileStoreReplaysRecordsInOrder) {
+  const char* path = journal("build/file.journal");
+  {
+    AsyncMqttClientFileSessionStore store(path);
+    CHECK(append(store, "first") && append(store, "second"));
+    AsyncMqttClientSessionRecordPart parts[] = {{reinterpret_cast<const uint8_t*>("in "), 3}, {reinterpret_cast<const uint8_t*>("parts"), 5}};
+    CHECK(store.append(parts, 2));
+    CHECK(replay(store) == std::vector<std::string>({"first", "second", "in parts"}));  // buffered ones too
+  }
+  AsyncMqttClientFileSessionStore reopened(path);
+  CHECK(replay(reopened) == std::vector<std::string>({"first", "second", "in parts"}));
+}
+
+TEST(fileStoreSyncsInBatches) {
+  const char* path = journal("build/batch.journal");
+  AsyncMqttClientFileSessionStore store(path, 2);
+  CHECK(append(store, "a"));
+  CHECK(fileSize(path) == 0);  // buffered
+  CHECK(append(store, "b"));
+  CHECK(fileSize(path) == 2 * (4 + 1));
+  CHECK(append(store, "c"));
+  store.sync();
+  CHECK(fileSize(path) == 3 * (4 + 1));
+}
+
+TEST(fileStoreStopsAtATornRecord) {
+  const char* path = journal("build/torn.journal");
+  {
+    AsyncMqttClientFileSessionStore store(path);
+    CHECK(append(store, "whole") && append(store, "torn"));
+  }
+  CHECK(truncate(path, fileSize(path) - 1) == 0);
+  AsyncMqttClientFileSessionStore store(path);
+  CHECK(replay(store) == std::vector<std::string>({"whole"}));
+
+  // a corrupt length is not read as a huge record
+  FILE* file = fopen(path, "r+b");
+  fseek(file, 4 + 5 + 3, SEEK_SET);
+  fputc(0x7F, file);
+  fclose(file);
+  CHECK(replay(store) == std::vector<std::string>({"whole"}));
+}
+
+TEST(fileStoreRewritesOrAborts) {
+  const char* path = journal("build/rewrite.journal");
+  AsyncMqttClientFileSessionStore store(path);
+  CHECK(append(store, "old") && append(store, "done"));
+  CHECK(store.beginRewrite() && append(store, "kept"));
+  CHECK(replay(store) == std::vector<std::string>({"old", "done"}));  // until committed
+  CHECK(store.commitRewrite());
+  CHECK(append(store, "new"));
+  CHECK(replay(store) == std::vector<std::string>({"kept", "new"}));
+
+  CHECK(store.beginRewrite() && append(store, "lost"));
+  store.abortRewrite();
+  CHECK(append(store, "after"));
+  CHECK(replay(store) == std::vector<std::string>({"kept", "new", "after"}));
+  CHECK(fileSize("build/rewrite.journal.tmp") == -1);
+}
+
+TEST(flashStoreReplaysAcrossReopen) {
+  RamFlash flash(2 * 4096);
+  {
+    AsyncMqttClientFlashSessionStore store(&flash);
+    CHECK(replay(store).empty());  // unformatted flash holds no records
+    CHECK(append(store, "first") && append(store, "second"));
+    CHECK(replay(store) == std::vector<std::string>({"first", "second"}));
+  }
+  AsyncMqttClientFlashSessionStore reopened(&flash);
+  CHECK(replay(reopened) == std::vector<std::string>({"first", "second"}));
+  int erases = flash.erases;
+  for (int i = 0; i < 100; i++) CHECK(append(reopened, "more"));
+  CHECK(flash.erases == erases);  // appends never erase
+}
+
+TEST(flashStoreDropsACorruptRecord) {
+  RamFlash flash(2 * 4096);
+  {
+    AsyncMqttClientFlashSessionStore store(&flash);
+    CHECK(append(store, "whole") && append(store, "corrupt") && append(store, "after"));
+  }
+  flash.memory[flash.find("corrupt")] ^= 0x01;
+  AsyncMqttClientFlashSessionStore store(&flash);
+  CHECK(replay(store) == std::vector<std::string>({"whole"}));
+}
+
+TEST(flashStoreRefusesRecordsWhenFull) {
+  RamFlash flash(2 * 4096);
+  AsyncMqttClientFlashSessionStore store(&flash);
+  std::string record(1000, 'x');
+  int appended = 0;
+  while (append(store, record)) appended++;
+  CHECK(appended == 4);  // one half, no wrapping over older records
+  CHECK(replay(store).size() == 4);
+  CHECK(store.beginRewrite() && append(store, "kept") && store.commitRewrite());
+  CHECK(append(store, record));
+  AsyncMqttClientFlashSessionStore reopened(&flash);
+  CHECK(replay(reopened) == std::vector<std::string>({"kept", record}));
+}
+
+TEST(flashStoreAbortsARewrite) {
+  RamFlash flash(2 * 4096);
+  AsyncMqttClientFlashSessionStore store(&flash);
+  CHECK(append(store, "old"));
+  CHECK(store.beginRewrite() && append(store, "lost"));
+  store.abortRewrite();
+  CHECK(append(store, "after"));
+  AsyncMqttClientFlashSessionStore reopened(&flash);
+  CHECK(replay(reopened) == std::vector<std::string>({"old", "after"}));
+}
+
+TEST(clientResendsJournaledPublishesAfterAReboot) {
+  RamFlash flash(8 * 4096);
+  uint16_t first, second;
+  {
+    AsyncMqttClient client;
+    client.setServer("broker", 1883).setCleanSession(false).setSessionStore(new AsyncMqttClientFlashSessionStore(&flash));
+    connectClient(client);
+    first = client.publish("t", 1, false, "first");
+    second = client.publish("t", 2, false, "second");
+    client.publish("t", 0, false, "not journaled");
+    tcp(client).takeSent();
+    tcp(client).receive(ack(4, first));  // PUBACK
+    // power loss
+  }
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setCleanSession(false).setSessionStore(new AsyncMqttClientFlashSessionStore(&flash));
+  connectClient(client, true);
+  std::vector<WirePacket> sent = packets(tcp(client).takeSent());
+  CHECK(sent.size() == 1 && sent[0].type == 3);
+  CHECK(publishId(sent[0]) == second && publishPayload(sent[0]) == "second");
+  CHECK((sent[0].flags & 0x08) != 0);  // DUP
+  CHECK(client.publish("t", 1, false, "next") != second);  // its packet ID stays taken
+}
+
+TEST(clientReportsACorruptJournaledPublish) {
+  RamFlash flash(2 * 4096);
+  AsyncMqttClientFlashSessionStore* store = new AsyncMqttClientFlashSessionStore(&flash);
+  // a PUBLISH record for packet ID 7 whose packet claims more bytes than it has
+  CHECK(append(*store, std::string("P\x00\x07\x32\x7F", 5)));
+  AsyncMqttClient client;
+  std::vector<std::pair<uint16_t, AsyncMqttClientError>> errors;
+  client.onError([&](uint16_t packetId, AsyncMqttClientError error) { errors.push_back({packetId, error}); });
+  client.setServer("broker", 1883).setCleanSession(false).setSessionStore(store);
+  CHECK(errors.size() == 1 && errors[0].first == 7 && errors[0].second == AsyncMqttClientError::SESSION_RECORD_DROPPED);
+  connectClient(client, true);
+  CHECK(packets(tcp(client).takeSent()).empty());
+  CHECK(replay(*store).empty());  // compacted away
+}
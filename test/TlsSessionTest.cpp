@@ -0,0 +1,132 @@
+#include "test.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+// The TLS layer of a server which caches sessions, in place of axTLS: it
+// resumes an offered session it knows, and otherwise makes a new one with a
+// full handshake.
+struct ServerTls : AsyncMqttClientTls {
+  std::vector<std::string> cache;
+  uint8_t certificate[MQTT_TLS_FINGERPRINT_SIZE];  // its fingerprint
+  std::string offered;  // by the last connection
+  bool resumed;
+  int handshakes;
+  int certificateChecks;
+
+  explicit ServerTls(uint8_t fingerprint) : resumed(false), handshakes(0), certificateChecks(0) {
+    memset(certificate, fingerprint, sizeof(certificate));
+  }
+  void offerSession(AsyncClient*, const uint8_t* id, uint8_t length) {
+    offered.assign(reinterpret_cast<const char*>(id), length);
+  }
+  // the handshake, as the client reads it once connected
+  uint8_t sessionId(AsyncClient*, uint8_t* id) {
+    resumed = !offered.empty() && std::find(cache.begin(), cache.end(), offered) != cache.end();
+    std::string session = resumed ? offered : "session " + std::to_string(++handshakes);
+    if (!resumed) cache.push_back(session);
+    memcpy(id, session.data(), session.size());
+    return session.size();
+  }
+  bool matchFingerprint(AsyncClient*, const uint8_t* fingerprint) {
+    certificateChecks++;
+    return !resumed && memcmp(certificate, fingerprint, sizeof(certificate)) == 0;  // a resumed handshake sends no certificate
+  }
+};
+
+static const uint8_t* fingerprint(uint8_t value) {
+  static uint8_t bytes[MQTT_TLS_FINGERPRINT_SIZE];
+  memset(bytes, value, sizeof(bytes));
+  return bytes;
+}
+
+static std::string session(const AsyncMqttClientTlsSession& session) {
+  return std::string(reinterpret_cast<const char*>(session.id), session.length);
+}
+
+// connects and reports how the connection ended if it was refused
+static AsyncMqttClientDisconnectReason connectRefused(AsyncMqttClient& client) {
+  AsyncMqttClientDisconnectReason reason = AsyncMqttClientDisconnectReason::TCP_DISCONNECTED;
+  client.onDisconnect([&](AsyncMqttClientDisconnectReason disconnectReason) { reason = disconnectReason; });
+  client.connect();
+  tcp(client).accept();
+  CHECK(!tcp(client).connected());
+  return reason;
+}
+
+static void reconnect(AsyncMqttClient& client) {
+  tcp(client).drop();
+  connectClient(client, true);
+}
+
+TEST(resumesTheSessionOfTheLastFullHandshake) {
+  ServerTls tls(0xAB);
+  AsyncMqttClient client;
+  client.setServer("broker", 8883).setSecure(true).addServerFingerprint(fingerprint(0xAB)).setTls(&tls);
+  connectClient(client);
+  CHECK(tcp(client).secure);
+  CHECK(tls.offered.empty() && tls.handshakes == 1 && tls.certificateChecks == 1);
+  AsyncMqttClientTlsSession kept = client.getTlsSession(0);
+  CHECK(session(kept) == "session 1" && memcmp(kept.fingerprint, fingerprint(0xAB), MQTT_TLS_FINGERPRINT_SIZE) == 0);
+
+  reconnect(client);
+  CHECK(tls.offered == "session 1" && tls.resumed && tls.handshakes == 1);
+  CHECK(client.getStats().tlsResumptions == 1);
+
+  tls.cache.clear();  // the server forgot it: a full handshake
+  reconnect(client);
+  CHECK(tls.offered == "session 1" && !tls.resumed && tls.handshakes == 2);
+  CHECK(session(client.getTlsSession(0)) == "session 2" && client.getStats().tlsResumptions == 1);
+}
+
+TEST(resumesARestoredSession) {
+  ServerTls tls(0xAB);
+  AsyncMqttClientTlsSession saved;
+  {
+    AsyncMqttClient client;
+    client.setServer("broker", 8883).setSecure(true).addServerFingerprint(fingerprint(0xAB)).setTls(&tls);
+    connectClient(client);
+    saved = client.getTlsSession(0);
+  }
+  AsyncMqttClient client;  // after a reboot
+  client.setServer("broker", 8883).setSecure(true).addServerFingerprint(fingerprint(0xAB)).setTls(&tls);
+  client.setTlsSession(0, saved);
+  connectClient(client);
+  CHECK(tls.resumed && client.getStats().tlsResumptions == 1);
+}
+
+TEST(refusesAResumedSessionMadeWithAnotherFingerprint) {
+  ServerTls tls(0xAB);
+  AsyncMqttClientTlsSession saved;
+  {
+    AsyncMqttClient client;
+    client.setServer("broker", 8883).setSecure(true).addServerFingerprint(fingerprint(0xAB)).setTls(&tls);
+    connectClient(client);
+    saved = client.getTlsSession(0);
+  }
+  AsyncMqttClient client;  // the old certificate is no longer accepted
+  client.setServer("broker", 8883).setSecure(true).addServerFingerprint(fingerprint(0xCD)).setTls(&tls);
+  client.setTlsSession(0, saved);
+  int checks = tls.certificateChecks;
+  CHECK(connectRefused(client) == AsyncMqttClientDisconnectReason::TLS_BAD_FINGERPRINT);
+  CHECK(tls.resumed && tls.certificateChecks == checks);  // no certificate to match
+  CHECK(client.getTlsSession(0).length == 0);
+  client.connect();
+  CHECK(tls.offered.empty());  // the next handshake is a full one
+}
+
+TEST(axTlsKeepsTheSessionWithoutOfferingIt) {
+  AsyncMqttClient client;
+  client.setServer("broker", 8883).setSecure(true).addServerFingerprint(fingerprint(0xAB));
+  SSL& ssl = tcp(client).ssl;
+  memset(ssl.fingerprint, 0xAB, sizeof(ssl.fingerprint));
+  memcpy(ssl.sessionId, "axtls", 5);
+  ssl.sessionIdSize = 5;
+  connectClient(client);
+  CHECK(session(client.getTlsSession(0)) == "axtls");
+  memcpy(ssl.sessionId, "newer", 5);  // a full handshake again, with another certificate
+  memset(ssl.fingerprint, 0xCD, sizeof(ssl.fingerprint));
+  tcp(client).drop();
+  CHECK(connectRefused(client) == AsyncMqttClientDisconnectReason::TLS_BAD_FINGERPRINT);
+}
@@ -0,0 +1,84 @@
+#include "test.hpp"
+
+#include <string.h>
+
+#include "AsyncMqttClient/Properties.hpp"
+#include "AsyncMqttClient/TopicAliases.hpp"
+
+using AsyncMqttClientInternals::PropertyReader;
+using AsyncMqttClientInternals::TopicAliases;
+
+static uint16_t alias(TopicAliases& aliases, const char* topic, bool* known) {
+  return aliases.alias(topic, strlen(topic), known);
+}
+
+// the integer properties read from a property section, as "id=value"
+static std::vector<std::string> properties(const std::string& section) {
+  PropertyReader reader;
+  std::vector<std::string> read;
+  for (char byte : section) {
+    if (reader.feed(byte)) read.push_back(std::to_string(reader.id()) + "=" + std::to_string(reader.value()));
+  }
+  return read;
+}
+
+TEST(givesAliasesInOrderThenReusesTheLeastRecentlyUsed) {
+  TopicAliases aliases;
+  aliases.reset(2);
+  bool known;
+  CHECK(alias(aliases, "first/topic", &known) == 1 && !known);
+  CHECK(alias(aliases, "first/topic", &known) == 1 && known);
+  CHECK(alias(aliases, "second/topic", &known) == 2 && !known);
+  CHECK(alias(aliases, "first/topic", &known) == 1 && known);
+  CHECK(alias(aliases, "third/topic", &known) == 2 && !known);  // second/topic was used least recently
+  CHECK(alias(aliases, "second/topic", &known) == 1 && !known);
+}
+
+TEST(givesNoAliasWhenDisabledOrNotWorthIt) {
+  TopicAliases aliases;
+  bool known = true;
+  CHECK(alias(aliases, "long/enough", &known) == 0 && !known);  // before a connection
+  aliases.reset(0);
+  CHECK(alias(aliases, "long/enough", &known) == 0);
+  aliases.reset(10);
+  CHECK(alias(aliases, "a/b", &known) == 0);  // no longer than the property
+  aliases.reset(MQTT_TOPIC_ALIASES + 10);
+  for (int i = 0; i < MQTT_TOPIC_ALIASES; i++) CHECK(alias(aliases, ("topic/" + std::to_string(i)).c_str(), &known) == i + 1);
+  CHECK(alias(aliases, "topic/more", &known) == 1);  // capped at MQTT_TOPIC_ALIASES
+  aliases.reset(10);
+  CHECK(alias(aliases, "topic/more", &known) == 1 && !known);  // forgotten on a new connection
+}
+
+TEST(readsIntegerPropertiesAndSkipsStrings) {
+  std::string section("\x21\x00\x0A"           // receive maximum, 2 bytes
+                      "\x1F\x00\x02ok"         // reason string
+                      "\x26\x00\x01k\x00\x01v"  // user property, a string pair
+                      "\x27\x00\x01\x00\x00"   // maximum packet size, 4 bytes
+                      "\x0B\x80\x01"           // subscription identifier, a variable byte integer
+                      "\x1C\x00\x00"           // empty server reference
+                      "\x24\x01",              // maximum QoS, 1 byte
+                      30);
+  CHECK(properties(section) == std::vector<std::string>({"33=10", "39=65536", "11=128", "36=1"}));
+}
+
+TEST(stopsAtAnUnknownProperty) {
+  CHECK(properties(std::string("\x24\x01\x7F\x24\x01", 5)) == std::vector<std::string>({"36=1"}));
+}
+
+TEST(clientPublishesWithTheAliasesTheBrokerAllows) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883).setProtocolVersion(5);
+  client.connect();
+  tcp(client).accept();
+  tcp(client).takeSent();
+  tcp(client).ack();
+  tcp(client).receive(packet(0x20, std::string("\x00\x00\x03\x22\x00\x01", 6)));  // topic alias maximum 1
+  CHECK(client.connected());
+  client.publish("sensors/temperature", 0, false, "21");
+  client.publish("sensors/temperature", 0, false, "22");
+  std::vector<WirePacket> sent = packets(tcp(client).takeSent());
+  CHECK(sent.size() == 2);
+  // topic, then the property section: its length and a topic alias
+  CHECK(sent[0].body == uint16(19) + "sensors/temperature" + std::string("\x03\x23\x00\x01", 4) + "21");
+  CHECK(sent[1].body == uint16(0) + std::string("\x03\x23\x00\x01", 4) + "22");
+}
@@ -0,0 +1,119 @@
+#include "test.hpp"
+
+#include <algorithm>
+
+#include "AsyncMqttClient/TopicTrie.hpp"
+
+using AsyncMqttClientInternals::TopicRoute;
+using AsyncMqttClientInternals::TopicTrie;
+
+// the filters matching topic, sorted
+static std::vector<std::string> matches(const TopicTrie& trie, const char* topic) {
+  std::vector<const TopicRoute*> routes;
+  trie.match(topic, [&](TopicRoute& route) { routes.push_back(&route); });
+  std::vector<std::string> filters;
+  trie.forEach([&](const std::string& filter, TopicRoute& route) {
+    for (const TopicRoute* matched : routes) {
+      if (matched == &route) filters.push_back(filter);
+    }
+  });
+  std::sort(filters.begin(), filters.end());
+  return filters;
+}
+
+static std::vector<std::string> list(std::vector<std::string> filters) {
+  std::sort(filters.begin(), filters.end());
+  return filters;
+}
+
+TEST(insertsAndFindsFilters) {
+  TopicTrie trie;
+  CHECK(trie.empty());
+  TopicRoute& route = trie.insert("a/+/c");
+  CHECK(&trie.insert("a/+/c") == &route);
+  CHECK(trie.find("a/+/c") == &route);
+  CHECK(trie.find("a/+") == nullptr);
+  CHECK(trie.find("a/b/c") == nullptr);
+  CHECK(!trie.empty());
+}
+
+TEST(matchesExactLevels) {
+  TopicTrie trie;
+  trie.insert("a/b");
+  trie.insert("a/b/c");
+  trie.insert("a");
+  CHECK(matches(trie, "a/b") == list({"a/b"}));
+  CHECK(matches(trie, "a/b/c") == list({"a/b/c"}));
+  CHECK(matches(trie, "a/bc").empty());
+  CHECK(matches(trie, "a/b/").empty());
+}
+
+TEST(matchesSingleLevelWildcard) {
+  TopicTrie trie;
+  trie.insert("a/+");
+  trie.insert("+/b");
+  trie.insert("+/+");
+  trie.insert("a/+/c");
+  CHECK(matches(trie, "a/b") == list({"a/+", "+/b", "+/+"}));
+  CHECK(matches(trie, "a/") == list({"a/+", "+/+"}));  // an empty level is a level
+  CHECK(matches(trie, "a/x/c") == list({"a/+/c"}));
+  CHECK(matches(trie, "a").empty());
+  CHECK(matches(trie, "a/b/c/d").empty());
+}
+
+TEST(matchesMultiLevelWildcardAndItsParent) {
+  TopicTrie trie;
+  trie.insert("a/#");
+  trie.insert("#");
+  trie.insert("a/+/#");
+  CHECK(matches(trie, "a") == list({"a/#", "#"}));
+  CHECK(matches(trie, "a/b") == list({"a/#", "#", "a/+/#"}));
+  CHECK(matches(trie, "a/b/c/d") == list({"a/#", "#", "a/+/#"}));
+  CHECK(matches(trie, "b") == list({"#"}));
+}
+
+TEST(wildcardsSkipDollarTopics) {
+  TopicTrie trie;
+  trie.insert("#");
+  trie.insert("+/monitor/Clients");
+  trie.insert("$SYS/#");
+  trie.insert("$SYS/monitor/+");
+  trie.insert("a/+");
+  CHECK(matches(trie, "$SYS/monitor/Clients") == list({"$SYS/#", "$SYS/monitor/+"}));
+  CHECK(matches(trie, "$SYS") == list({"$SYS/#"}));
+  CHECK(matches(trie, "a/$b") == list({"#", "a/+"}));  // only the first level counts
+}
+
+TEST(visitsEachFilterOnce) {
+  TopicTrie trie;
+  trie.insert("a/b").handlers.resize(3);
+  trie.insert("a/#");
+  int visits = 0;
+  trie.match("a/b", [&](TopicRoute&) { visits++; });
+  CHECK(visits == 2);
+}
+
+TEST(clientRoutesMessagesByFilter) {
+  AsyncMqttClient client;
+  client.setServer("broker", 1883);
+  std::vector<std::string> got;
+  client.onMessage("sensors/+/temperature", [&](char* topic, char*, AsyncMqttClientMessageProperties, size_t, size_t, size_t) {
+    got.push_back(std::string("temperature ") + topic);
+  });
+  client.onMessage("sensors/#", [&](char* topic, char*, AsyncMqttClientMessageProperties, size_t, size_t, size_t) {
+    got.push_back(std::string("sensors ") + topic);
+  });
+  client.onMessage("#", [&](char* topic, char*, AsyncMqttClientMessageProperties, size_t, size_t, size_t) {
+    got.push_back(std::string("all ") + topic);
+  });
+  connectClient(client);
+
+  tcp(client).receive(publish("sensors/kitchen/temperature", "21"));
+  CHECK(list(got) == list({"temperature sensors/kitchen/temperature", "sensors sensors/kitchen/temperature",
+                           "all sensors/kitchen/temperature"}));
+  got.clear();
+  tcp(client).receive(publish("$SYS/uptime", "1"));
+  CHECK(got.empty());
+  tcp(client).receive(publish("lights", "on"));
+  CHECK(got == list({"all lights"}));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Host stand-in of the parts of the Arduino core the library uses. Time only
+// moves when a test moves it.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <array>
+#include <string>
+
+extern uint32_t testMillis;
+
+inline uint32_t millis() { return testMillis; }
+inline long random(long howBig) { return howBig > 0 ? rand() % howBig : 0; }
+inline long random(long howSmall, long howBig) { return howSmall + random(howBig - howSmall); }
+
+class IPAddress {
+ public:
+  IPAddress() : _address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+  : _address(a | b << 8 | c << 16 | static_cast<uint32_t>(d) << 24) {}
+  explicit IPAddress(uint32_t address) : _address(address) {}
+  operator uint32_t() const { return _address; }
+  bool operator==(const IPAddress& other) const { return _address == other._address; }
+  bool operator!=(const IPAddress& other) const { return _address != other._address; }
+
+ private:
+  uint32_t _address;
+};
+
+class EspClass {
+ public:
+  unsigned long long getEfuseMac() { return 0x123456; }  // uint64_t on the ESP32
+  uint32_t getMaxAllocHeap() { return 100000; }
+};
+
+extern EspClass ESP;
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#if ASYNC_TCP_SSL_ENABLED
+#include "tcp_axtls.h"
+#endif
+
+// Host stand-in of the AsyncTCP client. The test plays the network and the
+// server: it completes the connection, delivers data and acks, polls, and
+// takes what the library sent.
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+
+class AsyncClient;
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void*, AsyncClient*, void* data, size_t len)> AcDataHandler;
+
+class AsyncClient {
+ public:
+  AsyncClient();
+  ~AsyncClient();
+  static AsyncClient* of(const void* owner, size_t size);  // the one which is a member of owner
+
+  void onConnect(AcConnectHandler handler, void* arg) { _onConnect = handler; _onConnectArg = arg; }
+  void onDisconnect(AcConnectHandler handler, void* arg) { _onDisconnect = handler; _onDisconnectArg = arg; }
+  void onAck(AcAckHandler handler, void* arg) { _onAck = handler; _onAckArg = arg; }
+  void onData(AcDataHandler handler, void* arg) { _onData = handler; _onDataArg = arg; }
+  void onPoll(AcConnectHandler handler, void* arg) { _onPoll = handler; _onPollArg = arg; }
+  void setNoDelay(bool) {}
+  void setRxTimeout(uint32_t) {}
+
+  bool connect(IPAddress ip, uint16_t port);
+  bool connect(const char* host, uint16_t port);
+#if ASYNC_TCP_SSL_ENABLED
+  bool connect(IPAddress ip, uint16_t port, bool secure);
+  bool connect(const char* host, uint16_t port, bool secure);
+  SSL* getSSL() { return &ssl; }
+#endif
+  void close(bool now = false);
+  bool connected() const { return _connected; }
+  IPAddress remoteIP() const { return ip; }
+
+  size_t space() const { return _connected ? _space : 0; }
+  size_t add(const char* data, size_t size, uint8_t flags = ASYNC_WRITE_FLAG_COPY);
+  bool send();
+
+  // test side
+  void accept();                         // the connection is established
+  void receive(const std::string& data);  // from the server, in one piece
+  void ack();                            // the server acknowledged everything sent
+  void poll();
+  void drop();                           // the connection is lost
+  std::string takeSent();                // sent since the last call
+
+  int connects;
+  std::string host;  // empty if connecting to ip
+  IPAddress ip;
+  uint16_t port;
+  std::string buffered;  // added, not sent yet
+  size_t sends;
+#if ASYNC_TCP_SSL_ENABLED
+  bool secure;
+  SSL ssl;  // as the handshake left it
+#endif
+
+ private:
+  AcConnectHandler _onConnect;
+  AcConnectHandler _onDisconnect;
+  AcAckHandler _onAck;
+  AcDataHandler _onData;
+  AcConnectHandler _onPoll;
+  void* _onConnectArg;
+  void* _onDisconnectArg;
+  void* _onAckArg;
+  void* _onDataArg;
+  void* _onPollArg;
+  bool _connected;
+  size_t _space;
+  size_t _unacked;
+  std::string _sent;
+};
@@ -0,0 +1,5 @@
+#pragma once
+
+#define log_i(...) do {} while (0)
+#define log_w(...) do {} while (0)
+#define log_e(...) do {} while (0)
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// No partition table on the host: tests give the flash store a flash of their own.
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define SPI_FLASH_SEC_SIZE 4096
+enum { ESP_PARTITION_TYPE_DATA = 1, ESP_PARTITION_SUBTYPE_ANY = 0xff };
+struct esp_partition_t { size_t size; };
+inline const esp_partition_t* esp_partition_find_first(int, int, const char*) { return nullptr; }
+inline esp_err_t esp_partition_read(const esp_partition_t*, size_t, void*, size_t) { return -1; }
+inline esp_err_t esp_partition_write(const esp_partition_t*, size_t, const void*, size_t) { return -1; }
+inline esp_err_t esp_partition_erase_range(const esp_partition_t*, size_t, size_t) { return -1; }
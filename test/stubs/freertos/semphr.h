@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+// The tests run on one thread. On an ESP32, a mutex taken in the lwIP thread
+// can deadlock with a task holding it while it calls into lwIP: it is counted.
+extern int testInLwipThread;  // calls made in the lwIP thread, nested
+extern int testLocksInLwipThread;
+
+typedef void* SemaphoreHandle_t;
+#define portMAX_DELAY 0xFFFFFFFF
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return reinterpret_cast<SemaphoreHandle_t>(1); }
+inline int xSemaphoreTake(SemaphoreHandle_t, uint32_t) {
+  if (testInLwipThread > 0) testLocksInLwipThread++;
+  return 1;
+}
+inline int xSemaphoreGive(SemaphoreHandle_t) { return 1; }
+inline void vSemaphoreDelete(SemaphoreHandle_t) {}
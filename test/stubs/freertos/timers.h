@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// One-shot software timers, fired by advanceMillis() in the test thread. The
+// tick is a millisecond.
+
+typedef uint32_t TickType_t;
+#define pdFALSE 0
+#define pdMS_TO_TICKS(ms) static_cast<TickType_t>(ms)
+
+struct TestTimer {
+  const char* name;
+  void* id;
+  void (*callback)(TestTimer* timer);
+  bool active;
+  uint32_t due;
+};
+typedef TestTimer* TimerHandle_t;
+
+std::vector<TestTimer*>& testTimers();
+void advanceMillis(uint32_t ms);
+
+inline TimerHandle_t xTimerCreate(const char* name, TickType_t, int, void* id, void (*callback)(TimerHandle_t)) {
+  TestTimer* timer = new TestTimer{name, id, callback, false, 0};
+  testTimers().push_back(timer);
+  return timer;
+}
+int xTimerChangePeriod(TimerHandle_t timer, TickType_t ticks, TickType_t);
+inline int xTimerStop(TimerHandle_t timer, TickType_t) { timer->active = false; return 1; }
+int xTimerDelete(TimerHandle_t timer, TickType_t);
+inline void* pvTimerGetTimerID(TimerHandle_t timer) { return timer->id; }
@@ -0,0 +1,224 @@
+// Definitions of the host stand-ins, linked into every test.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "Arduino.h"
+#include "AsyncTCP.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "lwip/dns.h"
+
+uint32_t testMillis = 1000;
+int testInLwipThread = 0;
+int testLocksInLwipThread = 0;
+EspClass ESP;
+
+/* timers */
+
+std::vector<TestTimer*>& testTimers() {
+  static std::vector<TestTimer*> timers;
+  return timers;
+}
+
+int xTimerChangePeriod(TimerHandle_t timer, TickType_t ticks, TickType_t) {
+  timer->active = true;
+  timer->due = testMillis + ticks;
+  return 1;
+}
+
+int xTimerDelete(TimerHandle_t timer, TickType_t) {
+  std::vector<TestTimer*>& timers = testTimers();
+  timers.erase(std::remove(timers.begin(), timers.end(), timer), timers.end());
+  delete timer;
+  return 1;
+}
+
+void advanceMillis(uint32_t ms) {
+  // fire the timers which come due on the way, in order
+  uint32_t end = testMillis + ms;
+  while (true) {
+    TestTimer* next = nullptr;
+    for (TestTimer* timer : testTimers()) {
+      if (timer->active && static_cast<int32_t>(timer->due - end) <= 0 &&
+          (!next || static_cast<int32_t>(timer->due - next->due) < 0)) {
+        next = timer;
+      }
+    }
+    if (!next) break;
+    if (static_cast<int32_t>(next->due - testMillis) > 0) testMillis = next->due;
+    next->active = false;
+    next->callback(next);
+  }
+  testMillis = end;
+}
+
+/* DNS */
+
+TestDns& testDns() {
+  static TestDns dns = {};
+  return dns;
+}
+
+err_t dns_gethostbyname(const char* name, ip_addr_t*, dns_found_callback found, void* arg) {
+  TestDns& dns = testDns();
+  dns.lookups++;
+  dns.name = name;
+  dns.found = found;
+  dns.arg = arg;
+  return ERR_INPROGRESS;
+}
+
+void answerLookup() {
+  TestDns& dns = testDns();
+  dns_found_callback found = dns.found;
+  if (!found) return;
+  dns.found = nullptr;
+  std::map<std::string, uint32_t>::const_iterator record = dns.records.find(dns.name);
+  ip_addr_t address;
+  address.type = IPADDR_TYPE_V4;
+  if (record != dns.records.end()) address.u_addr.addr = record->second;
+  testInLwipThread++;  // answers come in the lwIP thread
+  found(dns.name.c_str(), (record != dns.records.end()) ? &address : nullptr, dns.arg);
+  testInLwipThread--;
+}
+
+/* TCP */
+
+static std::vector<AsyncClient*>& clients() {
+  static std::vector<AsyncClient*> instances;
+  return instances;
+}
+
+AsyncClient::AsyncClient()
+: connects(0)
+, host()
+, ip()
+, port(0)
+, buffered()
+, sends(0)
+#if ASYNC_TCP_SSL_ENABLED
+, secure(false)
+, ssl()
+#endif
+, _onConnectArg(nullptr)
+, _onDisconnectArg(nullptr)
+, _onAckArg(nullptr)
+, _onDataArg(nullptr)
+, _onPollArg(nullptr)
+, _connected(false)
+, _space(5744)
+, _unacked(0)
+, _sent() {
+  clients().push_back(this);
+}
+
+AsyncClient::~AsyncClient() {
+  clients().erase(std::remove(clients().begin(), clients().end(), this), clients().end());
+}
+
+AsyncClient* AsyncClient::of(const void* owner, size_t size) {
+  const char* begin = static_cast<const char*>(owner);
+  for (AsyncClient* client : clients()) {
+    const char* address = reinterpret_cast<const char*>(client);
+    if (address >= begin && address < begin + size) return client;
+  }
+  return nullptr;
+}
+
+bool AsyncClient::connect(IPAddress ip, uint16_t port) {
+  connects++;
+  this->host.clear();
+  this->ip = ip;
+  this->port = port;
+  return true;
+}
+
+bool AsyncClient::connect(const char* host, uint16_t port) {
+  connects++;
+  this->host = host;
+  this->port = port;
+  return true;
+}
+
+#if ASYNC_TCP_SSL_ENABLED
+bool AsyncClient::connect(IPAddress ip, uint16_t port, bool secure) {
+  this->secure = secure;
+  return connect(ip, port);
+}
+
+bool AsyncClient::connect(const char* host, uint16_t port, bool secure) {
+  this->secure = secure;
+  return connect(host, port);
+}
+
+/* axTLS */
+
+uint8_t ssl_get_session_id_size(const SSL* ssl) {
+  return ssl->sessionIdSize;
+}
+
+const uint8_t* ssl_get_session_id(const SSL* ssl) {
+  return ssl->sessionId;
+}
+
+int ssl_match_fingerprint(const SSL* ssl, const uint8_t* fingerprint) {
+  return memcmp(ssl->fingerprint, fingerprint, sizeof(ssl->fingerprint)) == 0 ? SSL_OK : SSL_NOT_OK;
+}
+#endif
+
+void AsyncClient::close(bool) {
+  if (!_connected) return;
+  drop();
+}
+
+size_t AsyncClient::add(const char* data, size_t size, uint8_t) {
+  if (size > space()) size = space();
+  buffered.append(data, size);
+  _space -= size;
+  _unacked += size;
+  return size;
+}
+
+bool AsyncClient::send() {
+  sends++;
+  _sent += buffered;
+  buffered.clear();
+  return true;
+}
+
+void AsyncClient::accept() {
+  _connected = true;
+  _onConnect(_onConnectArg, this);
+}
+
+void AsyncClient::receive(const std::string& data) {
+  std::string copy = data;  // the library may parse in place
+  _onData(_onDataArg, this, &copy[0], copy.size());
+}
+
+void AsyncClient::ack() {
+  size_t length = _unacked;
+  _unacked = 0;
+  _space += length;
+  _onAck(_onAckArg, this, length, 0);
+}
+
+void AsyncClient::poll() {
+  _onPoll(_onPollArg, this);
+}
+
+void AsyncClient::drop() {
+  _connected = false;
+  _space += _unacked;
+  _unacked = 0;
+  buffered.clear();
+  _onDisconnect(_onDisconnectArg, this);
+}
+
+std::string AsyncClient::takeSent() {
+  std::string sent;
+  sent.swap(_sent);
+  return sent;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+// Host stand-in of the lwIP resolver. Lookups wait for the test to answer
+// them with answerLookup(), from the names in testDns().records.
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_INPROGRESS -5
+#define ERR_ARG -16
+
+struct ip4_addr_t { uint32_t addr; };
+struct ip_addr_t { ip4_addr_t u_addr; uint8_t type; };
+#define IPADDR_TYPE_V4 0
+#define IP_IS_V4(address) ((address)->type == IPADDR_TYPE_V4)
+#define ip_2_ip4(address) (&(address)->u_addr)
+#define ip4_addr_get_u32(address) ((address)->addr)
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* address, void* arg);
+
+struct TestDns {
+  std::map<std::string, uint32_t> records;
+  int lookups;
+  std::string name;  // of the pending lookup
+  dns_found_callback found;
+  void* arg;
+};
+TestDns& testDns();
+void answerLookup();  // answers the pending lookup, from the records
+
+err_t dns_gethostbyname(const char* name, ip_addr_t* address, dns_found_callback found, void* arg);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "freertos/semphr.h"
+#include "lwip/dns.h"
+
+// The tests run on one thread, which plays the lwIP thread during a call.
+
+struct tcpip_api_call_data { err_t err; };
+typedef err_t (*tcpip_api_call_fn)(struct tcpip_api_call_data* call);
+inline err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data* call) {
+  testInLwipThread++;
+  err_t err = fn(call);
+  testInLwipThread--;
+  return err;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in of the axTLS calls the library makes. The test fills in what
+// the handshake left in the connection.
+
+#define SSL_OK 0
+#define SSL_NOT_OK -1
+
+struct _SSL {
+  uint8_t sessionId[32];
+  uint8_t sessionIdSize;
+  uint8_t fingerprint[20];  // of the server certificate
+};
+typedef struct _SSL SSL;
+
+uint8_t ssl_get_session_id_size(const SSL* ssl);
+const uint8_t* ssl_get_session_id(const SSL* ssl);
+int ssl_match_fingerprint(const SSL* ssl, const uint8_t* fingerprint);
@@ -0,0 +1,118 @@
+#include "test.hpp"
+
+#include <stdio.h>
+
+std::vector<TestCase>& testCases() {
+  static std::vector<TestCase> cases;
+  return cases;
+}
+
+int main() {
+  int failures = 0;
+  for (const TestCase& test : testCases()) {
+    try {
+      test.run();
+    } catch (const TestFailure& failure) {
+      printf("%s:%d: %s failed: CHECK(%s)\n", failure.file, failure.line, test.name, failure.condition);
+      failures++;
+    }
+  }
+  printf("%zu tests, %d failed\n", testCases().size(), failures);
+  return failures == 0 ? 0 : 1;
+}
+
+uint16_t WirePacket::packetId() const {
+  return static_cast<uint8_t>(body[0]) << 8 | static_cast<uint8_t>(body[1]);
+}
+
+std::vector<WirePacket> packets(const std::string& wire) {
+  std::vector<WirePacket> result;
+  size_t position = 0;
+  while (position < wire.size()) {
+    WirePacket packet;
+    packet.type = static_cast<uint8_t>(wire[position]) >> 4;
+    packet.flags = wire[position] & 0x0F;
+    position++;
+    size_t length = 0;
+    size_t multiplier = 1;
+    uint8_t encoded;
+    do {
+      encoded = wire[position++];
+      length += (encoded & 0x7F) * multiplier;
+      multiplier *= 128;
+    } while (encoded & 0x80);
+    packet.body = wire.substr(position, length);
+    position += length;
+    result.push_back(packet);
+  }
+  return result;
+}
+
+std::string remainingLength(size_t length) {
+  std::string encoded;
+  do {
+    uint8_t digit = length % 128;
+    length /= 128;
+    if (length > 0) digit |= 0x80;
+    encoded += static_cast<char>(digit);
+  } while (length > 0);
+  return encoded;
+}
+
+std::string packet(uint8_t header, const std::string& body) {
+  return std::string(1, static_cast<char>(header)) + remainingLength(body.size()) + body;
+}
+
+std::string uint16(uint16_t value) {
+  return std::string(1, static_cast<char>(value >> 8)) + static_cast<char>(value & 0xFF);
+}
+
+std::string ack(uint8_t type, uint16_t packetId, uint8_t flags) {
+  return packet(type << 4 | flags, uint16(packetId));
+}
+
+std::string connAck(bool sessionPresent, uint8_t returnCode) {
+  return packet(0x20, std::string(1, sessionPresent ? 1 : 0) + static_cast<char>(returnCode));
+}
+
+std::string subAck(uint16_t packetId, const std::vector<uint8_t>& returnCodes) {
+  return packet(0x90, uint16(packetId) + std::string(returnCodes.begin(), returnCodes.end()));
+}
+
+std::string publish(const std::string& topic, const std::string& payload, uint8_t qos, uint16_t packetId, bool dup) {
+  std::string body = uint16(topic.size()) + topic;
+  if (qos > 0) body += uint16(packetId);
+  return packet(0x30 | qos << 1 | (dup ? 0x08 : 0), body + payload);
+}
+
+static size_t topicLength(const WirePacket& packet) {
+  return static_cast<uint8_t>(packet.body[0]) << 8 | static_cast<uint8_t>(packet.body[1]);
+}
+
+std::string publishTopic(const WirePacket& packet) {
+  return packet.body.substr(2, topicLength(packet));
+}
+
+uint16_t publishId(const WirePacket& packet) {
+  size_t position = 2 + topicLength(packet);
+  return static_cast<uint8_t>(packet.body[position]) << 8 | static_cast<uint8_t>(packet.body[position + 1]);
+}
+
+std::string publishPayload(const WirePacket& packet) {
+  bool qos = (packet.flags & 0x06) != 0;
+  return packet.body.substr(2 + topicLength(packet) + (qos ? 2 : 0));
+}
+
+AsyncClient& tcp(AsyncMqttClient& client) {
+  return *AsyncClient::of(&client, sizeof(client));
+}
+
+void connectClient(AsyncMqttClient& client, bool sessionPresent) {
+  client.connect();
+  tcp(client).accept();
+  std::vector<WirePacket> sent = packets(tcp(client).takeSent());
+  CHECK(sent.size() == 1 && sent[0].type == 1);
+  tcp(client).ack();
+  tcp(client).receive(connAck(sessionPresent));
+  CHECK(client.connected());
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <AsyncMqttClient.h>
+
+// A minimal test runner: TEST(name) { ... } registers a test, CHECK(condition)
+// fails it and moves on to the next one.
+
+struct TestFailure {
+  const char* file;
+  int line;
+  const char* condition;
+};
+
+struct TestCase {
+  const char* name;
+  void (*run)();
+};
+
+std::vector<TestCase>& testCases();
+
+struct TestRegistration {
+  TestRegistration(const char* name, void (*run)()) { testCases().push_back({name, run}); }
+};
+
+#define TEST(name) \
+  static void name(); \
+  static TestRegistration name##Registration(#name, name); \
+  static void name()
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) throw TestFailure{__FILE__, __LINE__, #condition}; \
+  } while (0)
+
+// MQTT on the wire
+
+struct WirePacket {
+  uint8_t type;
+  uint8_t flags;
+  std::string body;  // after the remaining length
+  uint16_t packetId() const;  // of an ack, SUBSCRIBE or UNSUBSCRIBE
+};
+
+std::vector<WirePacket> packets(const std::string& wire);
+std::string uint16(uint16_t value);  // big endian
+std::string remainingLength(size_t length);
+std::string packet(uint8_t header, const std::string& body);
+std::string ack(uint8_t type, uint16_t packetId, uint8_t flags = 0);  // PUBACK, PUBREC, PUBREL, PUBCOMP, UNSUBACK
+std::string connAck(bool sessionPresent = false, uint8_t returnCode = 0);
+std::string subAck(uint16_t packetId, const std::vector<uint8_t>& returnCodes);
+std::string publish(const std::string& topic, const std::string& payload, uint8_t qos = 0, uint16_t packetId = 0, bool dup = false);
+std::string publishTopic(const WirePacket& packet);
+uint16_t publishId(const WirePacket& packet);
+std::string publishPayload(const WirePacket& packet);
+
+// the TCP connection of a client, played by the test
+AsyncClient& tcp(AsyncMqttClient& client);
+// connect, and answer the CONNECT with a CONNACK
+void connectClient(AsyncMqttClient& client, bool sessionPresent = false);